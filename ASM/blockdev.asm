@@ -0,0 +1,173 @@
+;-------------------------------------------------------------------------
+;
+;  Block device driver, BASIC SAVE / LOAD
+;  Mapped as a ROM at $F000 (see BLKDRV[] in src/blkdrv.h)
+;
+;  From BASIC (immediate mode, one statement per line):
+;
+;    POKE -12256,S                  Slot S (0-31) in BLKL
+;    CALL -4096                     Save the program in the slot
+;    CALL -4093                     Load the program from the slot
+;    PRINT PEEK(-12251)             Status of the last command (0 = OK)
+;
+;  A slot is 32 blocks: the zero page first (BASIC pointers), then the
+;  program pages from PP to HIMEM.
+;
+;-------------------------------------------------------------------------
+
+                .CR     6502
+                .OR     $F000
+                .TF     BLKDRV.HEX,HEX,8
+
+;-------------------------------------------------------------------------
+;  Memory declaration
+;-------------------------------------------------------------------------
+
+LOMEM           .EQ     $4A             BASIC variables start
+HIMEM           .EQ     $4C             BASIC program end
+PP              .EQ     $CA             BASIC program start
+PV              .EQ     $CC             BASIC variables end
+
+BLKL            .EQ     $D020           Block number Low (slot on entry)
+BLKH            .EQ     $D021           Block number High
+BUFL            .EQ     $D022           Buffer address Low
+BUFH            .EQ     $D023           Buffer address High
+BLKCMD          .EQ     $D024           Command, executed on write
+BLKST           .EQ     $D025           Status, $00 = OK
+
+ECHO            .EQ     $FFEF           WOZ monitor print routine
+
+;-------------------------------------------------------------------------
+;  Constants
+;-------------------------------------------------------------------------
+
+CMD_READ        .EQ     $01             Block -> RAM
+CMD_WRITE       .EQ     $02             RAM -> Block
+CR              .EQ     $8D             Carriage Return
+
+;-------------------------------------------------------------------------
+;  Entry points
+;-------------------------------------------------------------------------
+
+SAVE            JMP     DOSAVE          CALL -4096
+LOAD            JMP     DOLOAD          CALL -4093
+
+;-------------------------------------------------------------------------
+;  Slot number in BLKL -> first block of the slot, buffer on a page
+;-------------------------------------------------------------------------
+
+SETSLOT         LDA     BLKL            Slot * 32
+                PHA
+                LSR
+                LSR
+                LSR
+                STA     BLKH
+                PLA
+                ASL
+                ASL
+                ASL
+                ASL
+                ASL
+                STA     BLKL
+                LDA     #0
+                STA     BUFL            Always whole pages
+                RTS
+
+;-------------------------------------------------------------------------
+;  Run the command in A, return the status (Z=1 if OK)
+;-------------------------------------------------------------------------
+
+DOCMD           STA     BLKCMD          The Due does it all in this cycle
+                LDA     BLKST
+                RTS
+
+;-------------------------------------------------------------------------
+;  SAVE: zero page, then the program pages
+;-------------------------------------------------------------------------
+
+DOSAVE          JSR     SETSLOT
+                LDA     #0              Zero page holds the pointers
+                STA     BUFH
+                LDA     #CMD_WRITE
+                JSR     DOCMD
+                BNE     ERROR
+                LDY     #CMD_WRITE
+                BNE     PAGES           Always taken
+
+;-------------------------------------------------------------------------
+;  LOAD: pointers from the saved zero page, then the program pages
+;-------------------------------------------------------------------------
+
+DOLOAD          JSR     SETSLOT
+                LDA     LOMEM+1         Saved zero page lands on the first
+                STA     BUFH             variables page, lost anyway
+                LDA     #CMD_READ
+                JSR     DOCMD
+                BNE     ERROR
+
+                LDA     LOMEM+1         PV -> saved zero page
+                STA     PV+1
+                LDY     #0
+                STY     PV
+                LDY     #HIMEM+1
+                LDA     (PV),Y
+                CMP     #$FF            Erased block, nothing saved there
+                BEQ     ERROR
+
+                LDY     #PP+1
+                LDA     (PV),Y
+                STA     PP+1
+                DEY
+                LDA     (PV),Y
+                STA     PP
+                LDY     #HIMEM+1        Copy LOMEM & HIMEM
+LDPTR           LDA     (PV),Y
+                STA     $0000,Y
+                DEY
+                CPY     #LOMEM-1
+                BNE     LDPTR
+
+                LDA     LOMEM           No variables after a LOAD
+                STA     PV
+                LDA     LOMEM+1
+                STA     PV+1
+                LDY     #CMD_READ
+
+;-------------------------------------------------------------------------
+;  Run the command in Y on every page from PP to HIMEM
+;-------------------------------------------------------------------------
+
+PAGES           LDA     PP+1
+                STA     BUFH
+NEXTPAGE        LDA     BUFH
+                CMP     HIMEM+1
+                BCC     PAGE            Below HIMEM page
+                BNE     DONE            Above, we're done
+                LDA     HIMEM           HIMEM page, only if not page aligned
+                BEQ     DONE
+PAGE            INC     BLKL
+                TYA
+                JSR     DOCMD
+                BNE     ERROR
+                INC     BUFH
+                BNE     NEXTPAGE        Always taken
+DONE            RTS
+
+;-------------------------------------------------------------------------
+;  Something went wrong, let the user know
+;-------------------------------------------------------------------------
+
+ERROR           LDX     #0
+ERRNEXT         LDA     ERRMSG,X
+                BEQ     DONE
+                JSR     ECHO
+                INX
+                BNE     ERRNEXT         Always taken
+
+ERRMSG          .DA     #CR
+                .AS     "*** I/O ERR"
+                .DA     #CR,#0
+
+;-------------------------------------------------------------------------
+
+                .LI     OFF
@@ -0,0 +1,57 @@
+#!/bin/sh
+# Recorded sessions of the host tools, with their expected output.
+#
+# Each NAME.txt keyboard script is run by headless three times, interpreted,
+# with -H and with -V, and the output must be NAME.out every time (-V must
+# also find no HLE difference). Each NAME.BAS listing goes through basic -v:
+# no ROM mismatch, the listing printed by -l must be NAME.LST and the
+# tokenize errors NAME.ERR (none if there's no such file).
+#
+#   pio run -e headless -e basic && sessions/run.sh
+#
+# HEADLESS / BASIC override the tools, 0 is returned when everything matched.
+
+cd "$(dirname "$0")" || exit 2
+HEADLESS=${HEADLESS:-../.pio/build/headless/program}
+BASIC=${BASIC:-../.pio/build/basic/program}
+CYCLES=40000000
+TMP=$(mktemp -d) || exit 2
+trap 'rm -rf "$TMP"' EXIT
+failed=0
+
+fail() {
+  echo "FAIL $*"
+  failed=$((failed + 1))
+}
+
+for script in *.txt; do
+  name=${script%.txt}
+  for mode in "" -H -V; do
+    # Per session options
+    case $name in
+      blockdev) rm -f "$TMP/disk.img"; set -- -d "$TMP/disk.img" ;;
+      listing) set -- -b STATEMENTS.BAS ;;
+      *) set -- ;;
+    esac
+    if ! "$HEADLESS" $mode "$@" -s "$script" -g "$name.out" -c $CYCLES -o "$TMP/out" 2> "$TMP/log"; then
+      fail "headless $mode $script"
+      grep -v "cycles in" "$TMP/log"
+    fi
+  done
+done
+
+for listing in *.BAS; do
+  name=${listing%.BAS}
+  "$BASIC" -v -l "$listing" > "$TMP/lst" 2> "$TMP/log"
+  grep -q ", 0 mismatches$" "$TMP/log" || fail "basic -v $listing: ROM mismatch"
+  cmp -s "$TMP/lst" "$name.LST" || fail "basic -l $listing: listing differs from $name.LST"
+  grep " ERR: " "$TMP/log" > "$TMP/err"
+  if [ -f "$name.ERR" ]; then
+    cmp -s "$TMP/err" "$name.ERR" || fail "basic $listing: errors differ from $name.ERR"
+  else
+    [ -s "$TMP/err" ] && fail "basic $listing: tokenize errors" && cat "$TMP/err"
+  fi
+done
+
+[ $failed = 0 ] && echo "sessions OK"
+[ $failed = 0 ]
@@ -0,0 +1,181 @@
+#include <stdint.h>
+#include "apple1.h"
+#include "config.h"
+#include "blockdev.h"
+#include "rewind.h"
+#include "rom.h"
+#include "blkdrv.h"
+#include "programs.h"
+
+unsigned char RAM_BANK_1[RAM_BANK_1_SIZE];
+unsigned char RAM_BANK_2[RAM_BANK_2_SIZE];
+
+unsigned int codeWatchStart = 0, codeWatchEnd = 0;
+bool codeWatchHit = true;
+
+unsigned char KBD   = 0;
+unsigned char KBDCR = 0;
+unsigned char DSP   = 0;
+unsigned char DSPCR = 0;
+
+void PIAWrite(unsigned int address, unsigned char data) {
+  switch (address) {
+
+    // Keyboard
+    case KBD_ADDR:
+      KBD=data;
+      break;
+
+    case KBDCR_ADDR:
+      KBDCR=data;
+      break;
+
+    // Display
+    case DSP_ADDR:
+      DSP=data;
+      displayWrite(DSP);
+      DSP &= 0x7F;
+      break;
+
+    case DSPCR_ADDR:
+      DSPCR=data;
+      break;
+  }
+}
+
+static_assert(isRegion(RAM_BANK1_ADDR, RAM_BANK_1_SIZE), "RAM bank 1 not a region");
+static_assert(isRegion(RAM_BANK2_ADDR, RAM_BANK_2_SIZE), "RAM bank 2 not a region");
+static_assert(isRegion(ROM_ADDR, ROM_SIZE), "ROM not a region");
+static_assert(isRegion(BLK_ADDR, BLK_REGS), "Block device not a region");
+
+// Address decode for a given config (config.h)
+template <class Config>
+inline void mapWrite(unsigned int address, unsigned char data) {
+  if (inRegion(address, RAM_BANK1_ADDR, RAM_BANK_1_SIZE)) {
+    if (Config::REWIND) rewindWrite(address, RAM_BANK_1[address-RAM_BANK1_ADDR]);
+    RAM_BANK_1[address-RAM_BANK1_ADDR]=data;
+  } else if (Config::ERAM && inRegion(address, RAM_BANK2_ADDR, RAM_BANK_2_SIZE)) {
+    if (Config::REWIND) rewindWrite(address, RAM_BANK_2[address-RAM_BANK2_ADDR]);
+    if (Config::HLE && address >= codeWatchStart && address < codeWatchEnd) codeWatchHit = true;
+    RAM_BANK_2[address-RAM_BANK2_ADDR]=data;
+  } else if (Config::BLOCK_DEV && inRegion(address, BLK_ADDR, BLK_REGS)) {
+    blockDevWrite(address, data);
+  } else if (inRegion(address, PIA_ADDR, 0x1000)) {
+    PIAWrite(address, data);
+  }
+}
+
+#if defined(ARDUINO)
+void busWrite(unsigned int address, unsigned char data) {
+  mapWrite<Machine>(address, data);
+}
+#else
+// Host: the writes go in the RAM journal only once a tool started it
+void busWrite(unsigned int address, unsigned char data) {
+  if (rewindOn()) {
+    mapWrite<RewindHostConfig>(address, data);
+  } else {
+    mapWrite<Machine>(address, data);
+  }
+}
+#endif
+
+unsigned char PIARead(unsigned int address) {
+  unsigned char val;
+  // PIA 6821
+  switch (address) {
+
+    case KBD_ADDR:
+      val=KBD;
+      // We'v read the char, clear B7
+      KBDCR &= 0x7F;
+      break;
+
+    case KBDCR_ADDR:
+      val=KBDCR;
+      break;
+
+    case DSP_ADDR:
+      val=DSP;
+      break;
+
+    case DSPCR_ADDR:
+      val=DSPCR;
+      break;
+
+    default:
+      val=0;
+      break;
+  }
+
+  return val;
+}
+
+template <class Config>
+inline unsigned char mapRead(unsigned int address) {
+  // $0000-$0FFF 4KB Standard RAM
+  if (inRegion(address, RAM_BANK1_ADDR, RAM_BANK_1_SIZE)) return RAM_BANK_1[address-RAM_BANK1_ADDR];
+
+  // $FF00-$FFFF 256 Bytes ROM
+  if (inRegion(address, ROM_ADDR, ROM_SIZE)) return ROM[address-ROM_ADDR];
+
+  // $E000-$EFFF 4KB Extended RAM
+  if (Config::ERAM && inRegion(address, RAM_BANK2_ADDR, RAM_BANK_2_SIZE)) return RAM_BANK_2[address-RAM_BANK2_ADDR];
+
+  // $D010-$D013 PIA (6821) [KBD & DSP]
+  // $D020-$D025 Block device
+  if (inRegion(address, PIA_ADDR, 0x1000)) {
+    if (Config::BLOCK_DEV && inRegion(address, BLK_ADDR, BLK_REGS)) return blockDevRead(address);
+    return PIARead(address);
+  }
+
+  // $F000-$F0FF Block device driver ROM
+  if (Config::BLOCK_DEV && address - BLKDRV_ADDR < sizeof(BLKDRV)) return BLKDRV[address-BLKDRV_ADDR];
+
+  // Segmentation Fault. Just return 0
+  return 0;
+}
+
+unsigned char busRead(unsigned int address) {
+  return mapRead<Machine>(address);
+}
+
+void keyPress(char key) {
+  switch (key) {
+    case 0xA:
+      // Not expected from KEYB
+      // Just ignore
+      return;
+    case 0x8:
+    case 0x7F:
+      // BS
+      key = 0x5F;
+      break;
+  }
+
+  KBD = key | 0x80;
+  KBDCR |= 0x80;
+}
+
+bool keyboardReady() {
+  return !(KBDCR & 0x80);
+}
+
+void loadBASIC() {
+  // LOAD BASIC in E000
+  for (unsigned int i = 0; i < sizeof(BASIC) ; i++) {
+    RAM_BANK_2[i] = BASIC[i];
+  }
+  codeWatchHit = true;
+}
+
+unsigned int loadPROG() {
+  // LOAD A PROG
+  unsigned int prg_addr = AUTLOAD[1] | AUTLOAD[0] << 8;
+
+  for (unsigned int i = 0; i < sizeof(AUTLOAD)-2 ; i++) {
+    RAM_BANK_1[prg_addr+i] = AUTLOAD[i+2];
+  }
+
+  return prg_addr;
+}
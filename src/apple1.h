@@ -0,0 +1,70 @@
+#ifndef APPLE1_H
+#define APPLE1_H
+
+// Apple 1 memory map & PIA (6821) emulation.
+// This part doesn't know anything about the Arduino: it's shared by the
+// Due sketch (main.cpp) and the native host tools (src/host).
+
+const unsigned int ROM_ADDR       = 0xFF00; // ROM
+const int ROM_SIZE = 256;
+const unsigned int RAM_BANK1_ADDR = 0x0000; // RAM
+const unsigned int RAM_BANK2_ADDR = 0xE000; // EXTENDED RAM
+
+const int RAM_BANK_1_SIZE = 4096;
+const int RAM_BANK_2_SIZE = 4096;
+extern unsigned char RAM_BANK_1[RAM_BANK_1_SIZE];
+extern unsigned char RAM_BANK_2[RAM_BANK_2_SIZE];
+
+// PIA MAPPING 6821
+const unsigned int PIA_ADDR   = 0xD000; // PIA 6821 ADDR BASE SPACE
+const unsigned int KBD_ADDR   = 0xD010; // Keyb Char - B7 High on keypress
+const unsigned int KBDCR_ADDR = 0xD011; // Keyb Status - B7 High on keypress / Low when ready
+const unsigned int DSP_ADDR   = 0xD012; // DSP Char
+const unsigned int DSPCR_ADDR = 0xD013; // DSP Status - B7 Low if VIDEO ready
+extern unsigned char KBD;
+extern unsigned char KBDCR;
+extern unsigned char DSP;
+extern unsigned char DSPCR;
+
+const unsigned char BS      = 0xDF;  // Backspace key, arrow left key (B7 High)
+const unsigned char CR      = 0x8D;  // Carriage Return (B7 High)
+const unsigned char ESC     = 0x9B;  // ESC key (B7 High)
+
+// I/O page ($D0xx): PIA & block device. The only accesses that may need
+// slow work on the Due, RAM & ROM cycles never wait.
+inline bool isIOAccess(unsigned int address) {
+  return (address & 0xFF00) == PIA_ADDR;
+}
+
+// True if the access can't be served yet and the 6502 has to wait on RDY:
+// a DSP write with no room in the serial output buffer (a CR takes 2 chars).
+inline bool ioMustWait(unsigned int address, bool read, int tx_free) {
+  return !read && address == DSP_ADDR && tx_free < 2;
+}
+
+// Code watch (host HLE, hle.h): the native routines stand in for the ERAM
+// code in [codeWatchStart, codeWatchEnd) and only check it again once
+// codeWatchHit is set. Bus writes in the range set it, and so does any
+// other way of changing the ERAM (load, block read, rewind).
+extern unsigned int codeWatchStart, codeWatchEnd;
+extern bool codeWatchHit;
+
+// Read / Write a byte at the given address of the Apple 1 address space
+unsigned char busRead(unsigned int address);
+void busWrite(unsigned int address, unsigned char data);
+
+// Latch a char from the keyboard source (serial, script...) into KBD
+void keyPress(char key);
+
+// True once the 6502 has read the last key (KBDCR B7 Low)
+bool keyboardReady();
+
+// DSP sink - every char written to DSP ends up here (B7 High as written
+// by the 6502). Implemented by the sketch / host tool.
+void displayWrite(unsigned char dsp);
+
+// Load BASIC in E000 and the AUTLOAD program, return the program address
+void loadBASIC();
+unsigned int loadPROG();
+
+#endif
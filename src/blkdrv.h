@@ -0,0 +1,24 @@
+// BLOCK DEVICE DRIVER ROM (ASM/blockdev.asm)
+const uint8_t BLKDRV[] = {0x4C, 0x26, 0xF0, 0x4C, 0x39, 0xF0, 0xAD, 0x20,
+0xD0, 0x48, 0x4A, 0x4A, 0x4A, 0x8D, 0x21, 0xD0,
+0x68, 0x0A, 0x0A, 0x0A, 0x0A, 0x0A, 0x8D, 0x20,
+0xD0, 0xA9, 0x00, 0x8D, 0x22, 0xD0, 0x60, 0x8D,
+0x24, 0xD0, 0xAD, 0x25, 0xD0, 0x60, 0x20, 0x06,
+0xF0, 0xA9, 0x00, 0x8D, 0x23, 0xD0, 0xA9, 0x02,
+0x20, 0x1F, 0xF0, 0xD0, 0x65, 0xA0, 0x02, 0xD0,
+0x40, 0x20, 0x06, 0xF0, 0xA5, 0x4B, 0x8D, 0x23,
+0xD0, 0xA9, 0x01, 0x20, 0x1F, 0xF0, 0xD0, 0x52,
+0xA5, 0x4B, 0x85, 0xCD, 0xA0, 0x00, 0x84, 0xCC,
+0xA0, 0x4D, 0xB1, 0xCC, 0xC9, 0xFF, 0xF0, 0x42,
+0xA0, 0xCB, 0xB1, 0xCC, 0x85, 0xCB, 0x88, 0xB1,
+0xCC, 0x85, 0xCA, 0xA0, 0x4D, 0xB1, 0xCC, 0x99,
+0x00, 0x00, 0x88, 0xC0, 0x49, 0xD0, 0xF6, 0xA5,
+0x4A, 0x85, 0xCC, 0xA5, 0x4B, 0x85, 0xCD, 0xA0,
+0x01, 0xA5, 0xCB, 0x8D, 0x23, 0xD0, 0xAD, 0x23,
+0xD0, 0xC5, 0x4D, 0x90, 0x06, 0xD0, 0x12, 0xA5,
+0x4C, 0xF0, 0x0E, 0xEE, 0x20, 0xD0, 0x98, 0x20,
+0x1F, 0xF0, 0xD0, 0x06, 0xEE, 0x23, 0xD0, 0xD0,
+0xE5, 0x60, 0xA2, 0x00, 0xBD, 0xA7, 0xF0, 0xF0,
+0xF8, 0x20, 0xEF, 0xFF, 0xE8, 0xD0, 0xF5, 0x8D,
+0x2A, 0x2A, 0x2A, 0x20, 0x49, 0x2F, 0x4F, 0x20,
+0x45, 0x52, 0x52, 0x8D, 0x00};
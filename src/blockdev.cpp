@@ -0,0 +1,122 @@
+#include <string.h>
+#include "apple1.h"
+#include "blockdev.h"
+#include "config.h"
+#include "rewind.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <DueFlashStorage.h>
+DueFlashStorage flash;
+#else
+#include <stdio.h>
+FILE *image = NULL;
+#endif
+
+unsigned int  blk_number = 0;
+unsigned int  blk_buffer = 0;
+unsigned char blk_status = BLK_OK;
+
+#ifdef ARDUINO
+
+bool storageRead(unsigned int block, unsigned char *data) {
+  memcpy(data, flash.readAddress(block * BLK_SIZE), BLK_SIZE);
+  return true;
+}
+
+bool storageWrite(unsigned int block, unsigned char *data) {
+  return flash.write(block * BLK_SIZE, data, BLK_SIZE);
+}
+
+#else
+
+bool blockDevOpen(const char *path) {
+  image = fopen(path, "r+b");
+  if (!image) image = fopen(path, "w+b");
+  return image != NULL;
+}
+
+bool storageRead(unsigned int block, unsigned char *data) {
+  if (!image) return false;
+
+  // Never written blocks read as erased flash
+  memset(data, 0xFF, BLK_SIZE);
+  fseek(image, block * BLK_SIZE, SEEK_SET);
+  fread(data, 1, BLK_SIZE, image);
+  return true;
+}
+
+bool storageWrite(unsigned int block, unsigned char *data) {
+  if (!image) return false;
+
+  // Fill any hole up to this block as erased flash
+  unsigned char erased[BLK_SIZE];
+  memset(erased, 0xFF, BLK_SIZE);
+  fseek(image, 0, SEEK_END);
+  for (long i = ftell(image) / BLK_SIZE; i < (long)block; i++) {
+    fwrite(erased, 1, BLK_SIZE, image);
+  }
+
+  fseek(image, block * BLK_SIZE, SEEK_SET);
+  return fwrite(data, 1, BLK_SIZE, image) == BLK_SIZE && fflush(image) == 0;
+}
+
+#endif
+
+// The emulated RAM holding the whole buffer, NULL if it's not all in RAM
+unsigned char *blockBuffer() {
+  switch (blk_buffer >> 12) {
+    case 0x0:
+      if (blk_buffer - RAM_BANK1_ADDR + BLK_SIZE > (unsigned int)RAM_BANK_1_SIZE) return NULL;
+      return RAM_BANK_1 + (blk_buffer - RAM_BANK1_ADDR);
+    case 0xE:
+      if (blk_buffer - RAM_BANK2_ADDR + BLK_SIZE > (unsigned int)RAM_BANK_2_SIZE) return NULL;
+      return RAM_BANK_2 + (blk_buffer - RAM_BANK2_ADDR);
+    default:
+      return NULL;
+  }
+}
+
+unsigned char blockCommand(unsigned char cmd) {
+  if (cmd != BLK_CMD_READ && cmd != BLK_CMD_WRITE) return BLK_ERR_CMD;
+  if (blk_number >= BLK_COUNT) return BLK_ERR_BLOCK;
+
+  unsigned char *data = blockBuffer();
+  if (!data) return BLK_ERR_BUFFER;
+
+  if (rewindOn() && cmd == BLK_CMD_READ) rewindRange(blk_buffer, data, BLK_SIZE);
+  if (Machine::HLE && cmd == BLK_CMD_READ) codeWatchHit = true;
+  bool ok = (cmd == BLK_CMD_READ) ? storageRead(blk_number, data) : storageWrite(blk_number, data);
+  return ok ? BLK_OK : BLK_ERR_MEDIA;
+}
+
+void blockDevWrite(unsigned int address, unsigned char data) {
+  switch (address) {
+    case BLKL_ADDR:
+      blk_number = (blk_number & 0xFF00) | data;
+      break;
+    case BLKH_ADDR:
+      blk_number = (blk_number & 0x00FF) | (data << 8);
+      break;
+    case BUFL_ADDR:
+      blk_buffer = (blk_buffer & 0xFF00) | data;
+      break;
+    case BUFH_ADDR:
+      blk_buffer = (blk_buffer & 0x00FF) | (data << 8);
+      break;
+    case BLKCMD_ADDR:
+      blk_status = blockCommand(data);
+      break;
+  }
+}
+
+unsigned char blockDevRead(unsigned int address) {
+  switch (address) {
+    case BLKL_ADDR:  return blk_number & 0xFF;
+    case BLKH_ADDR:  return blk_number >> 8;
+    case BUFL_ADDR:  return blk_buffer & 0xFF;
+    case BUFH_ADDR:  return blk_buffer >> 8;
+    case BLKST_ADDR: return blk_status;
+    default:         return 0;
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef BLOCKDEV_H
+#define BLOCKDEV_H
+
+// Block storage device, next to the PIA.
+// The 6502 sets block number & buffer address, then writes a command: the
+// whole 256 bytes block is moved between the storage and the emulated RAM
+// while the 6502 waits in that single write cycle.
+// Storage is the Due internal flash (bank 1), a file on the host.
+
+const unsigned int BLK_ADDR   = 0xD020; // BLOCK DEVICE ADDR BASE SPACE ($D020-$D02F)
+const unsigned int BLK_REGS   = 16;
+const unsigned int BLKL_ADDR  = 0xD020; // Block number Low
+const unsigned int BLKH_ADDR  = 0xD021; // Block number High
+const unsigned int BUFL_ADDR  = 0xD022; // Buffer address Low
+const unsigned int BUFH_ADDR  = 0xD023; // Buffer address High
+const unsigned int BLKCMD_ADDR = 0xD024; // Command - executed on write
+const unsigned int BLKST_ADDR = 0xD025; // Status of the last command
+
+const unsigned int BLKDRV_ADDR = 0xF000; // Driver ROM (ASM/blockdev.asm)
+
+const unsigned char BLK_CMD_READ  = 0x01; // Block -> RAM
+const unsigned char BLK_CMD_WRITE = 0x02; // RAM -> Block
+
+const unsigned char BLK_OK         = 0x00;
+const unsigned char BLK_ERR_MEDIA  = 0x80; // No storage / storage I/O error
+const unsigned char BLK_ERR_BLOCK  = 0x81; // Block number out of range
+const unsigned char BLK_ERR_BUFFER = 0x82; // Buffer not entirely in RAM
+const unsigned char BLK_ERR_CMD    = 0x83; // Unknown command
+
+const unsigned int BLK_SIZE  = 256;
+const unsigned int BLK_COUNT = 1024;    // 256KB, Due flash bank 1
+
+unsigned char blockDevRead(unsigned int address);
+void blockDevWrite(unsigned int address, unsigned char data);
+
+#ifndef ARDUINO
+// Attach a disk image, created if it doesn't exist
+bool blockDevOpen(const char *path);
+#endif
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// Machine configuration, resolved at compile time.
+// The sketch loop and the memory map decode are templates on one of these:
+// a disabled feature is a constant false condition and generates no code.
+// The configuration is picked by the build flags (see platformio.ini).
+
+enum Port {
+  PORT_NONE,      // Not fitted
+  PORT_SERIAL     // Programming port (Serial)
+};
+
+// Original replica: pot on A0, serial terminal, ERAM & block device
+struct Apple1Config {
+  // Memory map
+  static constexpr bool ERAM      = true;   // $E000-$EFFF extended RAM (BASIC)
+  static constexpr bool BLOCK_DEV = true;   // $D020 block device, $F000 driver ROM
+
+  // Due side
+  static constexpr bool POT       = true;   // Clock delay potentiometer on A0
+  static constexpr bool TRACE     = false;  // Bus trace on the native USB port
+  static constexpr bool STATS     = false;  // Due cycles per step on the native USB port
+  static constexpr bool REWIND    = false;  // RAM history, ^R N <CR> steps back N cycles
+  static constexpr bool HLE       = false;  // Native routines stand in for ERAM code (hle.h)
+  static constexpr Port KEYBOARD  = PORT_SERIAL;
+  static constexpr Port DISPLAY   = PORT_SERIAL;
+};
+
+// No pot: the clock runs as fast as the sketch serves the bus
+struct FastConfig : Apple1Config {
+  static constexpr bool POT = false;
+};
+
+// Fast, every served cycle sent on the native USB port
+struct TraceConfig : FastConfig {
+  static constexpr bool TRACE = true;
+};
+
+// Fast, step() cost reported on the native USB port
+struct StatsConfig : FastConfig {
+  static constexpr bool STATS = true;
+};
+
+// Fast, with the rewind buffer (rewind.h)
+struct RewindConfig : FastConfig {
+  static constexpr bool REWIND = true;
+};
+
+// Host tools: keyboard & display are the tool's own, no Due side at all
+struct HostConfig : Apple1Config {
+  static constexpr bool POT      = false;
+  static constexpr Port KEYBOARD = PORT_NONE;
+  static constexpr Port DISPLAY  = PORT_NONE;
+  static constexpr bool HLE      = true;
+};
+
+// Host tools with the RAM history, picked at run time once a tool starts it
+// (rewindStart(), test/test_rewind)
+struct RewindHostConfig : HostConfig {
+  static constexpr bool REWIND = true;
+};
+
+#if !defined(ARDUINO)
+typedef HostConfig Machine;
+#elif defined(BUS_TRACE)
+typedef TraceConfig Machine;
+#elif defined(REWIND_BUFFER)
+typedef RewindConfig Machine;
+#elif defined(STEP_STATS)
+typedef StatsConfig Machine;
+#elif defined(NO_POT)
+typedef FastConfig Machine;
+#else
+typedef Apple1Config Machine;
+#endif
+
+// Memory regions are power of two sized blocks aligned on their size, so
+// decoding an address is a constant mask & compare
+constexpr unsigned int regionMask(unsigned int size) {
+  return 0xFFFF & ~(size - 1);
+}
+
+constexpr bool isRegion(unsigned int base, unsigned int size) {
+  return size && !(size & (size - 1)) && !(base & (size - 1));
+}
+
+constexpr bool inRegion(unsigned int address, unsigned int base, unsigned int size) {
+  return (address & regionMask(size)) == base;
+}
+
+#endif
@@ -0,0 +1,423 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include "cpu6502.h"
+#include "apple1.h"
+#include "trace.h"
+
+void (*cpuBusTrace)(unsigned int address, unsigned char data, unsigned char flags) = NULL;
+
+// Trap table, one entry per PC. Allocated by the first cpuSetTrap().
+struct TrapEntry {
+  CpuTrap run;
+  void    *context;
+};
+
+static TrapEntry *traps = NULL;
+
+void cpuSetTrap(unsigned int pc, CpuTrap trap, void *context) {
+  if (!traps) {
+    traps = (TrapEntry *)calloc(0x10000, sizeof(TrapEntry));
+    if (!traps) return;
+  }
+  traps[pc & 0xFFFF].run = trap;
+  traps[pc & 0xFFFF].context = context;
+}
+
+// Every bus cycle of the software CPU goes through these two
+static inline unsigned char memRead(unsigned int address) {
+  unsigned char data = busRead(address);
+  if (cpuBusTrace) cpuBusTrace(address, data, TRACE_READ);
+  return data;
+}
+
+static inline void memWrite(unsigned int address, unsigned char data) {
+  if (cpuBusTrace) cpuBusTrace(address, data, 0);
+  busWrite(address, data);
+}
+
+static unsigned char fetch(CPU6502 &cpu) {
+  unsigned char val = memRead(cpu.pc);
+  cpu.pc = (cpu.pc + 1) & 0xFFFF;
+  return val;
+}
+
+static unsigned int fetchWord(CPU6502 &cpu) {
+  unsigned int lo = fetch(cpu);
+  return lo | (fetch(cpu) << 8);
+}
+
+static unsigned int readWord(unsigned int addr) {
+  return memRead(addr) | (memRead((addr + 1) & 0xFFFF) << 8);
+}
+
+static unsigned int readZPWord(unsigned char zp) {
+  return memRead(zp) | (memRead((zp + 1) & 0xFF) << 8);
+}
+
+static void push(CPU6502 &cpu, unsigned char val) {
+  memWrite(0x100 | cpu.sp, val);
+  cpu.sp--;
+}
+
+static unsigned char pull(CPU6502 &cpu) {
+  cpu.sp++;
+  return memRead(0x100 | cpu.sp);
+}
+
+static void setNZ(CPU6502 &cpu, unsigned char val) {
+  cpu.p &= ~(FLAG_N | FLAG_Z);
+  cpu.p |= val & FLAG_N;
+  if (!val) cpu.p |= FLAG_Z;
+}
+
+static void setFlag(CPU6502 &cpu, unsigned char flag, bool on) {
+  if (on) cpu.p |= flag; else cpu.p &= ~flag;
+}
+
+static void compare(CPU6502 &cpu, unsigned char reg, unsigned char val) {
+  setFlag(cpu, FLAG_C, reg >= val);
+  setNZ(cpu, reg - val);
+}
+
+// ADC / SBC, 65C02 flavour: N & Z are valid in decimal mode too (+1 cycle)
+static unsigned int adc(CPU6502 &cpu, unsigned char val) {
+  unsigned int c = cpu.p & FLAG_C;
+  unsigned int bin = cpu.a + val + c;
+  setFlag(cpu, FLAG_V, ~(cpu.a ^ val) & (cpu.a ^ bin) & 0x80);
+
+  if (!(cpu.p & FLAG_D)) {
+    setFlag(cpu, FLAG_C, bin > 0xFF);
+    cpu.a = bin;
+    setNZ(cpu, cpu.a);
+    return 0;
+  }
+
+  unsigned int lo = (cpu.a & 0x0F) + (val & 0x0F) + c;
+  unsigned int hi = (cpu.a >> 4) + (val >> 4);
+  if (lo > 9) { lo += 6; hi++; }
+  if (hi > 9) hi += 6;
+  setFlag(cpu, FLAG_C, hi > 0x0F);
+  cpu.a = (hi << 4) | (lo & 0x0F);
+  setNZ(cpu, cpu.a);
+  return 1;
+}
+
+static unsigned int sbc(CPU6502 &cpu, unsigned char val) {
+  int borrow = (cpu.p & FLAG_C) ? 0 : 1;
+  int bin = cpu.a - val - borrow;
+  setFlag(cpu, FLAG_V, (cpu.a ^ val) & (cpu.a ^ bin) & 0x80);
+  setFlag(cpu, FLAG_C, bin >= 0);
+
+  if (!(cpu.p & FLAG_D)) {
+    cpu.a = bin;
+    setNZ(cpu, cpu.a);
+    return 0;
+  }
+
+  int lo = (cpu.a & 0x0F) - (val & 0x0F) - borrow;
+  int hi = (cpu.a >> 4) - (val >> 4);
+  if (lo < 0) { lo -= 6; hi--; }
+  if (hi < 0) hi -= 6;
+  cpu.a = ((hi & 0x0F) << 4) | (lo & 0x0F);
+  setNZ(cpu, cpu.a);
+  return 1;
+}
+
+// Shifts & rotates, shared by the accumulator and the memory versions
+static unsigned char shift(CPU6502 &cpu, const char *name, unsigned char val) {
+  unsigned char carry = cpu.p & FLAG_C;
+  switch (name[0] << 8 | name[2]) {
+    case 'A' << 8 | 'L':  // ASL
+      setFlag(cpu, FLAG_C, val & 0x80);
+      val <<= 1;
+      break;
+    case 'L' << 8 | 'R':  // LSR
+      setFlag(cpu, FLAG_C, val & 0x01);
+      val >>= 1;
+      break;
+    case 'R' << 8 | 'L':  // ROL
+      setFlag(cpu, FLAG_C, val & 0x80);
+      val = (val << 1) | carry;
+      break;
+    case 'R' << 8 | 'R':  // ROR
+      setFlag(cpu, FLAG_C, val & 0x01);
+      val = (val >> 1) | (carry << 7);
+      break;
+    case 'I' << 8 | 'C':  // INC
+      val++;
+      break;
+    case 'D' << 8 | 'C':  // DEC
+      val--;
+      break;
+  }
+  setNZ(cpu, val);
+  return val;
+}
+
+static unsigned int branch(CPU6502 &cpu, bool taken, unsigned char offset) {
+  if (!taken) return 0;
+  unsigned int target = (cpu.pc + (signed char)offset) & 0xFFFF;
+  unsigned int extra = ((target ^ cpu.pc) & 0xFF00) ? 2 : 1;
+  cpu.pc = target;
+  return extra;
+}
+
+void cpuReset(CPU6502 &cpu) {
+  cpu.a = cpu.x = cpu.y = 0;
+  cpu.sp = 0xFD;
+  cpu.p = FLAG_U | FLAG_I;
+  cpu.pc = readWord(0xFFFC);
+  cpu.cycles = 7;
+  cpu.stopped = false;
+  cpu.traps = false;
+}
+
+unsigned int cpuStep(CPU6502 &cpu) {
+  if (cpu.stopped) {
+    cpu.cycles++;
+    return 1;
+  }
+
+  if (cpu.traps && traps && traps[cpu.pc].run) {
+    const TrapEntry &trap = traps[cpu.pc];
+    unsigned int cycles = trap.run(cpu, trap.context);
+    if (cycles) {
+      cpu.cycles += cycles;
+      return cycles;
+    }
+  }
+
+  unsigned char op = fetch(cpu);
+  const Opcode &opcode = OPCODES[op];
+  unsigned int cycles = opcode.cycles;
+  unsigned int ea = 0;
+  bool crossed = false;   // Index crossed a page (+1 cycle on reads)
+  unsigned int base;
+
+  switch (opcode.mode) {
+    case AM_IMM: ea = cpu.pc; cpu.pc = (cpu.pc + 1) & 0xFFFF; break;
+    case AM_ZP:  ea = fetch(cpu); break;
+    case AM_ZPX: ea = (fetch(cpu) + cpu.x) & 0xFF; break;
+    case AM_ZPY: ea = (fetch(cpu) + cpu.y) & 0xFF; break;
+    case AM_ABS: ea = fetchWord(cpu); break;
+    case AM_ABX:
+      base = fetchWord(cpu);
+      ea = (base + cpu.x) & 0xFFFF;
+      crossed = (base ^ ea) & 0xFF00;
+      break;
+    case AM_ABY:
+      base = fetchWord(cpu);
+      ea = (base + cpu.y) & 0xFFFF;
+      crossed = (base ^ ea) & 0xFF00;
+      break;
+    case AM_IND: ea = readWord(fetchWord(cpu)); break;
+    case AM_IZX: ea = readZPWord(fetch(cpu) + cpu.x); break;
+    case AM_IZY:
+      base = readZPWord(fetch(cpu));
+      ea = (base + cpu.y) & 0xFFFF;
+      crossed = (base ^ ea) & 0xFF00;
+      break;
+    case AM_IZP: ea = readZPWord(fetch(cpu)); break;
+    case AM_AIX: ea = readWord((fetchWord(cpu) + cpu.x) & 0xFFFF); break;
+    case AM_REL: ea = fetch(cpu); break;
+    case AM_ZPR: ea = fetch(cpu); break;
+  }
+
+  unsigned char val;
+
+  switch (op) {
+    // Loads & Stores
+    case 0xA9: case 0xA5: case 0xB5: case 0xAD: case 0xBD: case 0xB9:
+    case 0xA1: case 0xB1: case 0xB2:
+      cpu.a = memRead(ea); setNZ(cpu, cpu.a); cycles += crossed;
+      break;
+    case 0xA2: case 0xA6: case 0xB6: case 0xAE: case 0xBE:
+      cpu.x = memRead(ea); setNZ(cpu, cpu.x); cycles += crossed;
+      break;
+    case 0xA0: case 0xA4: case 0xB4: case 0xAC: case 0xBC:
+      cpu.y = memRead(ea); setNZ(cpu, cpu.y); cycles += crossed;
+      break;
+    case 0x85: case 0x95: case 0x8D: case 0x9D: case 0x99:
+    case 0x81: case 0x91: case 0x92:
+      memWrite(ea, cpu.a);
+      break;
+    case 0x86: case 0x96: case 0x8E:
+      memWrite(ea, cpu.x);
+      break;
+    case 0x84: case 0x94: case 0x8C:
+      memWrite(ea, cpu.y);
+      break;
+    case 0x64: case 0x74: case 0x9C: case 0x9E:
+      memWrite(ea, 0);
+      break;
+
+    // Arithmetic & Logic
+    case 0x69: case 0x65: case 0x75: case 0x6D: case 0x7D: case 0x79:
+    case 0x61: case 0x71: case 0x72:
+      cycles += adc(cpu, memRead(ea)) + crossed;
+      break;
+    case 0xE9: case 0xE5: case 0xF5: case 0xED: case 0xFD: case 0xF9:
+    case 0xE1: case 0xF1: case 0xF2:
+      cycles += sbc(cpu, memRead(ea)) + crossed;
+      break;
+    case 0x29: case 0x25: case 0x35: case 0x2D: case 0x3D: case 0x39:
+    case 0x21: case 0x31: case 0x32:
+      cpu.a &= memRead(ea); setNZ(cpu, cpu.a); cycles += crossed;
+      break;
+    case 0x09: case 0x05: case 0x15: case 0x0D: case 0x1D: case 0x19:
+    case 0x01: case 0x11: case 0x12:
+      cpu.a |= memRead(ea); setNZ(cpu, cpu.a); cycles += crossed;
+      break;
+    case 0x49: case 0x45: case 0x55: case 0x4D: case 0x5D: case 0x59:
+    case 0x41: case 0x51: case 0x52:
+      cpu.a ^= memRead(ea); setNZ(cpu, cpu.a); cycles += crossed;
+      break;
+    case 0xC9: case 0xC5: case 0xD5: case 0xCD: case 0xDD: case 0xD9:
+    case 0xC1: case 0xD1: case 0xD2:
+      compare(cpu, cpu.a, memRead(ea)); cycles += crossed;
+      break;
+    case 0xE0: case 0xE4: case 0xEC:
+      compare(cpu, cpu.x, memRead(ea));
+      break;
+    case 0xC0: case 0xC4: case 0xCC:
+      compare(cpu, cpu.y, memRead(ea));
+      break;
+    case 0x89:
+      // BIT #imm only touches Z
+      setFlag(cpu, FLAG_Z, !(cpu.a & memRead(ea)));
+      break;
+    case 0x24: case 0x34: case 0x2C: case 0x3C:
+      val = memRead(ea);
+      setFlag(cpu, FLAG_Z, !(cpu.a & val));
+      cpu.p = (cpu.p & ~(FLAG_N | FLAG_V)) | (val & (FLAG_N | FLAG_V));
+      cycles += crossed;
+      break;
+
+    // Read / Modify / Write
+    case 0x0A: case 0x4A: case 0x2A: case 0x6A: case 0x1A: case 0x3A:
+      cpu.a = shift(cpu, opcode.name, cpu.a);
+      break;
+    case 0x06: case 0x16: case 0x0E: case 0x1E:
+    case 0x46: case 0x56: case 0x4E: case 0x5E:
+    case 0x26: case 0x36: case 0x2E: case 0x3E:
+    case 0x66: case 0x76: case 0x6E: case 0x7E:
+    case 0xE6: case 0xF6: case 0xEE: case 0xFE:
+    case 0xC6: case 0xD6: case 0xCE: case 0xDE:
+      memWrite(ea, shift(cpu, opcode.name, memRead(ea)));
+      break;
+    case 0x04: case 0x0C:
+      val = memRead(ea);
+      setFlag(cpu, FLAG_Z, !(cpu.a & val));
+      memWrite(ea, val | cpu.a);
+      break;
+    case 0x14: case 0x1C:
+      val = memRead(ea);
+      setFlag(cpu, FLAG_Z, !(cpu.a & val));
+      memWrite(ea, val & ~cpu.a);
+      break;
+
+    // Registers
+    case 0xE8: cpu.x++; setNZ(cpu, cpu.x); break;
+    case 0xC8: cpu.y++; setNZ(cpu, cpu.y); break;
+    case 0xCA: cpu.x--; setNZ(cpu, cpu.x); break;
+    case 0x88: cpu.y--; setNZ(cpu, cpu.y); break;
+    case 0xAA: cpu.x = cpu.a; setNZ(cpu, cpu.x); break;
+    case 0x8A: cpu.a = cpu.x; setNZ(cpu, cpu.a); break;
+    case 0xA8: cpu.y = cpu.a; setNZ(cpu, cpu.y); break;
+    case 0x98: cpu.a = cpu.y; setNZ(cpu, cpu.a); break;
+    case 0xBA: cpu.x = cpu.sp; setNZ(cpu, cpu.x); break;
+    case 0x9A: cpu.sp = cpu.x; break;
+
+    // Stack
+    case 0x48: push(cpu, cpu.a); break;
+    case 0xDA: push(cpu, cpu.x); break;
+    case 0x5A: push(cpu, cpu.y); break;
+    case 0x08: push(cpu, cpu.p | FLAG_B | FLAG_U); break;
+    case 0x68: cpu.a = pull(cpu); setNZ(cpu, cpu.a); break;
+    case 0xFA: cpu.x = pull(cpu); setNZ(cpu, cpu.x); break;
+    case 0x7A: cpu.y = pull(cpu); setNZ(cpu, cpu.y); break;
+    case 0x28: cpu.p = pull(cpu) | FLAG_U | FLAG_B; break;
+
+    // Flags
+    case 0x18: cpu.p &= ~FLAG_C; break;
+    case 0x38: cpu.p |= FLAG_C; break;
+    case 0x58: cpu.p &= ~FLAG_I; break;
+    case 0x78: cpu.p |= FLAG_I; break;
+    case 0xB8: cpu.p &= ~FLAG_V; break;
+    case 0xD8: cpu.p &= ~FLAG_D; break;
+    case 0xF8: cpu.p |= FLAG_D; break;
+
+    // Branches
+    case 0x10: cycles += branch(cpu, !(cpu.p & FLAG_N), ea); break;
+    case 0x30: cycles += branch(cpu, cpu.p & FLAG_N, ea); break;
+    case 0x50: cycles += branch(cpu, !(cpu.p & FLAG_V), ea); break;
+    case 0x70: cycles += branch(cpu, cpu.p & FLAG_V, ea); break;
+    case 0x90: cycles += branch(cpu, !(cpu.p & FLAG_C), ea); break;
+    case 0xB0: cycles += branch(cpu, cpu.p & FLAG_C, ea); break;
+    case 0xD0: cycles += branch(cpu, !(cpu.p & FLAG_Z), ea); break;
+    case 0xF0: cycles += branch(cpu, cpu.p & FLAG_Z, ea); break;
+    case 0x80: cycles += branch(cpu, true, ea) - 1; break;
+
+    // Jumps & Subroutines
+    case 0x4C: case 0x6C: case 0x7C:
+      cpu.pc = ea;
+      break;
+    case 0x20:
+      base = (cpu.pc - 1) & 0xFFFF;
+      push(cpu, base >> 8);
+      push(cpu, base & 0xFF);
+      cpu.pc = ea;
+      break;
+    case 0x60:
+      base = pull(cpu);
+      base |= pull(cpu) << 8;
+      cpu.pc = (base + 1) & 0xFFFF;
+      break;
+    case 0x40:
+      cpu.p = pull(cpu) | FLAG_U | FLAG_B;
+      base = pull(cpu);
+      cpu.pc = base | (pull(cpu) << 8);
+      break;
+    case 0x00:
+      base = (cpu.pc + 1) & 0xFFFF;   // Skip the signature byte
+      push(cpu, base >> 8);
+      push(cpu, base & 0xFF);
+      push(cpu, cpu.p | FLAG_B | FLAG_U);
+      cpu.p = (cpu.p | FLAG_I) & ~FLAG_D;
+      cpu.pc = readWord(0xFFFE);
+      break;
+
+    // Bit manipulation (Rockwell / WDC)
+    case 0x07: case 0x17: case 0x27: case 0x37:
+    case 0x47: case 0x57: case 0x67: case 0x77:
+      memWrite(ea, memRead(ea) & ~(1 << (op >> 4)));
+      break;
+    case 0x87: case 0x97: case 0xA7: case 0xB7:
+    case 0xC7: case 0xD7: case 0xE7: case 0xF7:
+      memWrite(ea, memRead(ea) | (1 << ((op >> 4) - 8)));
+      break;
+    case 0x0F: case 0x1F: case 0x2F: case 0x3F:
+    case 0x4F: case 0x5F: case 0x6F: case 0x7F:
+      val = memRead(ea);
+      cycles += branch(cpu, !(val & (1 << (op >> 4))), fetch(cpu));
+      break;
+    case 0x8F: case 0x9F: case 0xAF: case 0xBF:
+    case 0xCF: case 0xDF: case 0xEF: case 0xFF:
+      val = memRead(ea);
+      cycles += branch(cpu, val & (1 << ((op >> 4) - 8)), fetch(cpu));
+      break;
+
+    // WAI & STP: IRQ / NMI / RES are not wired, nothing would wake us up
+    case 0xCB: case 0xDB:
+      cpu.stopped = true;
+      break;
+
+    // Everything else is a NOP. Operands were skipped without touching
+    // the bus: a dummy read of KBD would eat a key.
+    default:
+      break;
+  }
+
+  cpu.cycles += cycles;
+  return cycles;
+}
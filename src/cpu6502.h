@@ -0,0 +1,77 @@
+#ifndef CPU6502_H
+#define CPU6502_H
+
+// Software W65C02S core.
+// Used when there is no physical 6502 wired to the bus (host tools).
+// Every memory access goes through busRead() / busWrite() (apple1.h) so the
+// PIA side effects (KBDCR B7, DSP output) are exactly the ones the real chip
+// triggers through the Due.
+
+// Addressing modes
+enum {
+  AM_IMP,   // Implied
+  AM_ACC,   // Accumulator
+  AM_IMM,   // #$nn
+  AM_ZP,    // $nn
+  AM_ZPX,   // $nn,X
+  AM_ZPY,   // $nn,Y
+  AM_ABS,   // $nnnn
+  AM_ABX,   // $nnnn,X
+  AM_ABY,   // $nnnn,Y
+  AM_IND,   // ($nnnn)
+  AM_IZX,   // ($nn,X)
+  AM_IZY,   // ($nn),Y
+  AM_IZP,   // ($nn)
+  AM_REL,   // Branch
+  AM_AIX,   // ($nnnn,X)
+  AM_ZPR    // $nn,Branch (BBR / BBS)
+};
+
+struct Opcode {
+  const char    *name;
+  unsigned char mode;
+  unsigned char cycles;   // Base cycles (no page cross / branch taken)
+};
+
+// Opcode tables (opcodes.cpp), also used by the trace analyzer
+extern const Opcode OPCODES[256];
+extern const unsigned char MODE_SIZE[];   // Instruction size by addressing mode
+
+// Status register
+const unsigned char FLAG_C = 0x01;
+const unsigned char FLAG_Z = 0x02;
+const unsigned char FLAG_I = 0x04;
+const unsigned char FLAG_D = 0x08;
+const unsigned char FLAG_B = 0x10;
+const unsigned char FLAG_U = 0x20;
+const unsigned char FLAG_V = 0x40;
+const unsigned char FLAG_N = 0x80;
+
+struct CPU6502 {
+  unsigned int  pc;
+  unsigned char a, x, y, sp, p;
+  unsigned long cycles;   // Total cycles since reset
+  bool stopped;           // STP executed, only a reset wakes it up
+  bool traps;             // Run the traps set with cpuSetTrap(), off after a reset
+};
+
+// High level emulation trap: native code standing in for the 6502 routine
+// at a PC. It leaves registers, flags, memory & I/O exactly as the 6502 code
+// would, sets the PC where that code ends and returns the cycles it would
+// have taken. Returning 0 declines (nothing touched): the 6502 code runs.
+// context is the one given to cpuSetTrap() for that PC.
+typedef unsigned int (*CpuTrap)(CPU6502 &cpu, void *context);
+
+// Set the trap at this PC (NULL clears it)
+void cpuSetTrap(unsigned int pc, CpuTrap trap, void *context);
+
+// Called on every bus cycle when set (flags as in trace.h)
+extern void (*cpuBusTrace)(unsigned int address, unsigned char data, unsigned char flags);
+
+// Load PC from the RESET vector ($FFFC)
+void cpuReset(CPU6502 &cpu);
+
+// Execute a single instruction, return the cycles it took
+unsigned int cpuStep(CPU6502 &cpu);
+
+#endif
@@ -0,0 +1,500 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hle.h"
+#include "apple1.h"
+
+// WOZ monitor (ROM)
+const unsigned int IN_ADDR       = 0x0200;  // Input buffer
+const unsigned int NEXTCHAR_ADDR = 0xFF29;  // GETLINE key loop
+const unsigned int NEXTCHAR_RET  = 0xFF36;  // Pushed by its JSR ECHO
+const unsigned int PRBYTE_ADDR   = 0xFFDC;
+const unsigned int PRBYTE_RET    = 0xFFE3;  // Pushed by its JSR PRHEX
+const unsigned int ECHO_ADDR     = 0xFFEF;
+
+// Apple 1 BASIC (RAM at $E000, checked again after a write to it)
+const unsigned int COUT_ADDR     = 0xE3C9;  // Print A, keeps the column in CH
+const unsigned int MUL_LOOP      = 0xE225;  // 16 bit multiply, shift & add loop
+const unsigned int MUL_DONE      = 0xE244;
+const unsigned int MUL_OVERFLOW  = 0xE241;  // JMP to the >32767 error
+const unsigned int DIV_LOOP      = 0xEE7A;  // 16 bit divide, shift & subtract loop
+const unsigned int DIV_DONE      = 0xEE99;  // RTS
+
+const unsigned char CH   = 0x24;  // Cursor column
+const unsigned char ACC  = 0xCE;  // Multiplier / dividend -> quotient
+const unsigned char AUX  = 0xDA;  // Multiplicand / divisor
+const unsigned char P3   = 0xE6;  // Product / remainder
+
+const unsigned char COUT_CODE[] = {
+  0xC9, 0x8D, 0xD0, 0x06, 0xA9, 0x00, 0x85, 0x24, 0xA9, 0x8D, 0xE6, 0x24,
+  0x2C, 0x12, 0xD0, 0x30, 0xFB, 0x8D, 0x12, 0xD0, 0x60
+};
+
+const unsigned char MUL_CODE[] = {
+  0x06, 0xCE, 0x26, 0xCF, 0x90, 0x0D, 0x18, 0xA5, 0xE6, 0x65, 0xDA, 0x85,
+  0xE6, 0xA5, 0xE7, 0x65, 0xDB, 0x85, 0xE7, 0x88, 0xF0, 0x09, 0x06, 0xE6,
+  0x26, 0xE7, 0x10, 0xE4
+};
+
+const unsigned char DIV_CODE[] = {
+  0x06, 0xCE, 0x26, 0xCF, 0x26, 0xE6, 0x26, 0xE7, 0xA5, 0xE6, 0xC5, 0xDA,
+  0xA5, 0xE7, 0xE5, 0xDB, 0x90, 0x0A, 0x85, 0xE7, 0xA5, 0xE6, 0xE5, 0xDA,
+  0x85, 0xE6, 0xE6, 0xCE, 0x88, 0xD0, 0xE1, 0x60
+};
+
+bool hleShadow = false;
+void (*hleMismatch)(const HleRoutine &routine, const char *what,
+  unsigned int where, unsigned int expected, unsigned int got) = NULL;
+
+// I/O writes of a run, compared by the verify mode
+const int IO_LOG_SIZE = 16;
+
+struct IoLog {
+  int count;
+  unsigned int address[IO_LOG_SIZE];
+  unsigned char data[IO_LOG_SIZE];
+
+  void add(unsigned int addr, unsigned char val) {
+    if (count < IO_LOG_SIZE) {
+      address[count] = addr;
+      data[count] = val;
+    }
+    count++;
+  }
+};
+
+static IoLog *io_log = NULL;  // Logging the writes of the current run
+
+// Bus access of the native routines: the same busRead / busWrite the
+// interpreter goes through
+static void store(unsigned int address, unsigned char data) {
+  if (io_log && isIOAccess(address)) io_log->add(address, data);
+  busWrite(address, data);
+}
+
+// 6502 side effects, binary mode only (the routines decline with D set)
+static void setNZ(CPU6502 &cpu, unsigned char val) {
+  cpu.p &= ~(FLAG_N | FLAG_Z);
+  cpu.p |= val & FLAG_N;
+  if (!val) cpu.p |= FLAG_Z;
+}
+
+static void setFlag(CPU6502 &cpu, unsigned char flag, bool on) {
+  if (on) cpu.p |= flag; else cpu.p &= ~flag;
+}
+
+static void lda(CPU6502 &cpu, unsigned char val) {
+  cpu.a = val;
+  setNZ(cpu, val);
+}
+
+static void cmp(CPU6502 &cpu, unsigned char val) {
+  setFlag(cpu, FLAG_C, cpu.a >= val);
+  setNZ(cpu, cpu.a - val);
+}
+
+static void adc(CPU6502 &cpu, unsigned char val) {
+  unsigned int sum = cpu.a + val + (cpu.p & FLAG_C);
+  setFlag(cpu, FLAG_V, ~(cpu.a ^ val) & (cpu.a ^ sum) & 0x80);
+  setFlag(cpu, FLAG_C, sum > 0xFF);
+  lda(cpu, sum);
+}
+
+static void sbc(CPU6502 &cpu, unsigned char val) {
+  int diff = cpu.a - val - ((cpu.p & FLAG_C) ? 0 : 1);
+  setFlag(cpu, FLAG_V, (cpu.a ^ val) & (cpu.a ^ diff) & 0x80);
+  setFlag(cpu, FLAG_C, diff >= 0);
+  lda(cpu, diff);
+}
+
+static unsigned char asl(CPU6502 &cpu, unsigned char val) {
+  setFlag(cpu, FLAG_C, val & 0x80);
+  val <<= 1;
+  setNZ(cpu, val);
+  return val;
+}
+
+static unsigned char rol(CPU6502 &cpu, unsigned char val) {
+  unsigned char carry = cpu.p & FLAG_C;
+  setFlag(cpu, FLAG_C, val & 0x80);
+  val = (val << 1) | carry;
+  setNZ(cpu, val);
+  return val;
+}
+
+static void push(CPU6502 &cpu, unsigned char val) {
+  store(0x100 | cpu.sp, val);
+  cpu.sp--;
+}
+
+static unsigned int rts(CPU6502 &cpu) {
+  cpu.sp++;
+  unsigned int ret = busRead(0x100 | cpu.sp);
+  cpu.sp++;
+  ret |= busRead(0x100 | cpu.sp) << 8;
+  cpu.pc = (ret + 1) & 0xFFFF;
+  return 6;
+}
+
+// BIT DSP / BMI (not taken) / STA DSP. The callers checked DSP B7 is Low,
+// the 6502 would loop on it otherwise.
+static unsigned int dspWrite(CPU6502 &cpu) {
+  unsigned char dsp = busRead(DSP_ADDR);
+  setFlag(cpu, FLAG_Z, !(cpu.a & dsp));
+  cpu.p = (cpu.p & ~(FLAG_N | FLAG_V)) | (dsp & (FLAG_N | FLAG_V));
+  store(DSP_ADDR, cpu.a);
+  return 4 + 2 + 4;
+}
+
+// AND #$0F / ORA #$B0 / CMP #$BA / BCC ECHO [/ ADC #$06], then ECHO up to its RTS
+static unsigned int prhex(CPU6502 &cpu) {
+  unsigned int cycles = 2 + 2 + 2;
+  cpu.a = (cpu.a & 0x0F) | 0xB0;
+  if (cpu.a < 0xBA) {
+    cycles += 3;
+  } else {
+    cpu.a += 0x06 + 1;      // C set by the CMP
+    cycles += 2 + 2;
+  }
+  setFlag(cpu, FLAG_C, false);
+  return cycles + dspWrite(cpu);
+}
+
+// ECHO: print A
+static unsigned int hleEcho(CPU6502 &cpu) {
+  if (DSP & 0x80) return 0;
+  unsigned int cycles = dspWrite(cpu);
+  return cycles + rts(cpu);
+}
+
+// PRBYTE: print A as 2 hex digits
+static unsigned int hlePrbyte(CPU6502 &cpu) {
+  if ((cpu.p & FLAG_D) || (DSP & 0x80)) return 0;
+
+  unsigned char byte = cpu.a;
+  push(cpu, byte);                      // PHA
+  cpu.a = byte >> 4;                    // LSR x4
+  push(cpu, PRBYTE_RET >> 8);           // JSR PRHEX
+  push(cpu, PRBYTE_RET & 0xFF);
+  unsigned int cycles = 3 + 4 * 2 + 6;
+
+  cycles += prhex(cpu);
+  cpu.sp += 2;                          // RTS
+  cpu.sp++;                             // PLA
+  cpu.a = byte;
+  cycles += 6 + 4;
+
+  cycles += prhex(cpu);
+  return cycles + rts(cpu);
+}
+
+// GETLINE, NEXTCHAR: wait for a key, store it in IN & echo it. One pass of
+// the loop for a plain key, CR / BS / ESC & a full buffer are left to the 6502.
+static unsigned int hleNextChar(CPU6502 &cpu) {
+  if (!(KBDCR & 0x80)) {
+    lda(cpu, busRead(KBDCR_ADDR));      // LDA KBDCR / BPL NEXTCHAR
+    return 4 + 3;
+  }
+
+  if (KBD == CR || KBD == BS || KBD == ESC || cpu.y >= 0x7F || (DSP & 0x80)) return 0;
+
+  cpu.a = busRead(KBD_ADDR);            // LDA KBD (clears KBDCR B7)
+  store(IN_ADDR + cpu.y, cpu.a);        // STA IN,Y
+  push(cpu, NEXTCHAR_RET >> 8);         // JSR ECHO
+  push(cpu, NEXTCHAR_RET & 0xFF);
+  unsigned int cycles = 4 + 2 + 4 + 5 + 6;
+
+  cycles += dspWrite(cpu) + 6;          // ECHO, RTS
+  cpu.sp += 2;
+
+  // CMP #CR / BNE NOTCR / CMP #BS / BEQ / CMP #ESC / BEQ / INY / BPL NEXTCHAR
+  setFlag(cpu, FLAG_C, cpu.a >= ESC);
+  cpu.y++;
+  setNZ(cpu, cpu.y);
+  cpu.pc = NEXTCHAR_ADDR;
+  return cycles + 2 + 3 + 2 + 2 + 2 + 2 + 2 + 3;
+}
+
+// BASIC COUT: print A, CR resets the column
+static unsigned int hleCout(CPU6502 &cpu) {
+  if (DSP & 0x80) return 0;
+
+  unsigned int cycles;
+  unsigned char ch = busRead(CH);
+  setFlag(cpu, FLAG_C, cpu.a >= CR);    // CMP #CR
+  if (cpu.a == CR) {
+    ch = 0;                             // BNE / LDA #0 / STA CH / LDA #CR
+    store(CH, ch);
+    cycles = 2 + 2 + 2 + 3 + 2;
+  } else {
+    cycles = 2 + 3;
+  }
+
+  store(CH, ch + 1);                    // INC CH
+  cycles += 5 + dspWrite(cpu);
+  return cycles + rts(cpu);
+}
+
+// BASIC multiply, the loop after the setup (Y = 16). Ends on the last bit or
+// on an overflow.
+static unsigned int hleMulLoop(CPU6502 &cpu) {
+  if (cpu.p & FLAG_D) return 0;
+
+  unsigned char acc_lo = busRead(ACC), acc_hi = busRead(ACC + 1);
+  unsigned char aux_lo = busRead(AUX), aux_hi = busRead(AUX + 1);
+  unsigned char p3_lo = busRead(P3), p3_hi = busRead(P3 + 1);
+  unsigned int cycles = 0;
+
+  for (;;) {
+    acc_lo = asl(cpu, acc_lo);          // ASL ACC / ROL ACC+1 / BCC
+    acc_hi = rol(cpu, acc_hi);
+    cycles += 5 + 5;
+    if (cpu.p & FLAG_C) {
+      setFlag(cpu, FLAG_C, false);      // CLC / P3 += AUX
+      lda(cpu, p3_lo);
+      adc(cpu, aux_lo);
+      p3_lo = cpu.a;
+      lda(cpu, p3_hi);
+      adc(cpu, aux_hi);
+      p3_hi = cpu.a;
+      cycles += 2 + 2 + 3 + 3 + 3 + 3 + 3 + 3;
+    } else {
+      cycles += 3;
+    }
+
+    cpu.y--;                            // DEY / BEQ
+    setNZ(cpu, cpu.y);
+    if (!cpu.y) {
+      cpu.pc = MUL_DONE;
+      cycles += 2 + 3;
+      break;
+    }
+
+    p3_lo = asl(cpu, p3_lo);            // ASL P3 / ROL P3+1 / BPL
+    p3_hi = rol(cpu, p3_hi);
+    cycles += 2 + 2 + 5 + 5;
+    if (p3_hi & 0x80) {
+      cpu.pc = MUL_OVERFLOW;
+      cycles += 2;
+      break;
+    }
+    cycles += 3;
+  }
+
+  store(ACC, acc_lo);
+  store(ACC + 1, acc_hi);
+  store(P3, p3_lo);
+  store(P3 + 1, p3_hi);
+  return cycles;
+}
+
+// BASIC divide, the loop after the setup (Y = 16, divisor not 0), up to the RTS
+static unsigned int hleDivLoop(CPU6502 &cpu) {
+  if (cpu.p & FLAG_D) return 0;
+
+  unsigned char acc_lo = busRead(ACC), acc_hi = busRead(ACC + 1);
+  unsigned char aux_lo = busRead(AUX), aux_hi = busRead(AUX + 1);
+  unsigned char p3_lo = busRead(P3), p3_hi = busRead(P3 + 1);
+  unsigned int cycles = 0;
+
+  for (;;) {
+    acc_lo = asl(cpu, acc_lo);          // ASL ACC / ROL ACC+1 / ROL P3 / ROL P3+1
+    acc_hi = rol(cpu, acc_hi);
+    p3_lo = rol(cpu, p3_lo);
+    p3_hi = rol(cpu, p3_hi);
+
+    lda(cpu, p3_lo);                    // P3 - AUX / BCC
+    cmp(cpu, aux_lo);
+    lda(cpu, p3_hi);
+    sbc(cpu, aux_hi);
+    cycles += 4 * 5 + 4 * 3;
+    if (cpu.p & FLAG_C) {
+      p3_hi = cpu.a;                    // P3 -= AUX / INC ACC
+      lda(cpu, p3_lo);
+      sbc(cpu, aux_lo);
+      p3_lo = cpu.a;
+      acc_lo++;
+      setNZ(cpu, acc_lo);
+      cycles += 2 + 3 + 3 + 3 + 3 + 5;
+    } else {
+      cycles += 3;
+    }
+
+    cpu.y--;                            // DEY / BNE
+    setNZ(cpu, cpu.y);
+    if (!cpu.y) {
+      cpu.pc = DIV_DONE;
+      cycles += 2 + 2;
+      break;
+    }
+    cycles += 2 + 3;
+  }
+
+  store(ACC, acc_lo);
+  store(ACC + 1, acc_hi);
+  store(P3, p3_lo);
+  store(P3 + 1, p3_hi);
+  return cycles;
+}
+
+HleRoutine HLE_ROUTINES[] = {
+  {"ECHO",     ECHO_ADDR,     hleEcho,     NULL,      0,                 true, 0, 0, 0},
+  {"PRBYTE",   PRBYTE_ADDR,   hlePrbyte,   NULL,      0,                 true, 0, 0, 0},
+  {"NEXTCHAR", NEXTCHAR_ADDR, hleNextChar, NULL,      0,                 true, 0, 0, 0},
+  {"COUT",     COUT_ADDR,     hleCout,     COUT_CODE, sizeof(COUT_CODE), false, 0, 0, 0},
+  {"MUL",      MUL_LOOP,      hleMulLoop,  MUL_CODE,  sizeof(MUL_CODE),  false, 0, 0, 0},
+  {"DIV",      DIV_LOOP,      hleDivLoop,  DIV_CODE,  sizeof(DIV_CODE),  false, 0, 0, 0}
+};
+
+const int HLE_COUNT = sizeof(HLE_ROUTINES) / sizeof(HLE_ROUTINES[0]);
+
+static bool codeAt(unsigned int address, const unsigned char *code, unsigned int size) {
+  for (unsigned int i = 0; i < size; i++) {
+    if (busRead(address + i) != code[i]) return false;
+  }
+  return true;
+}
+
+// The RAM routines run only while their 6502 code is in place. It is
+// compared once, then again only after the code watch saw a write to it.
+static bool codeReady(HleRoutine &routine) {
+  if (codeWatchHit) {
+    codeWatchHit = false;
+    for (int i = 0; i < HLE_COUNT; i++) {
+      HleRoutine &r = HLE_ROUTINES[i];
+      if (r.code) r.code_ok = codeAt(r.pc, r.code, r.code_size);
+    }
+  }
+  return routine.code_ok;
+}
+
+static unsigned int trap(CPU6502 &cpu, void *context) {
+  HleRoutine &routine = *(HleRoutine *)context;
+  if (!codeReady(routine)) return 0;
+  unsigned int cycles = routine.run(cpu);
+  if (cycles) routine.calls++;
+  return cycles;
+}
+
+// Verify mode ---------------------------------------------------------------
+
+// What a routine can change besides the registers
+struct Snapshot {
+  unsigned char ram1[RAM_BANK_1_SIZE];
+  unsigned char ram2[RAM_BANK_2_SIZE];
+  unsigned char kbd, kbdcr, dsp, dspcr;
+  IoLog io;     // Native run only
+};
+
+static Snapshot *before = NULL, *native = NULL;
+static IoLog interpreted;
+
+static void save(Snapshot &s) {
+  memcpy(s.ram1, RAM_BANK_1, sizeof(s.ram1));
+  memcpy(s.ram2, RAM_BANK_2, sizeof(s.ram2));
+  s.kbd = KBD;
+  s.kbdcr = KBDCR;
+  s.dsp = DSP;
+  s.dspcr = DSPCR;
+}
+
+static void restore(const Snapshot &s) {
+  memcpy(RAM_BANK_1, s.ram1, sizeof(s.ram1));
+  memcpy(RAM_BANK_2, s.ram2, sizeof(s.ram2));
+  KBD = s.kbd;
+  KBDCR = s.kbdcr;
+  DSP = s.dsp;
+  DSPCR = s.dspcr;
+}
+
+static void logBus(unsigned int address, unsigned char data, unsigned char flags) {
+  if (!flags && isIOAccess(address)) interpreted.add(address, data);
+}
+
+static bool check(const HleRoutine &routine, const char *what, unsigned int where,
+  unsigned int expected, unsigned int got) {
+  if (expected == got) return true;
+  if (hleMismatch) hleMismatch(routine, what, where, expected, got);
+  return false;
+}
+
+static unsigned int verifyTrap(CPU6502 &cpu, void *context) {
+  HleRoutine &routine = *(HleRoutine *)context;
+  if (!codeReady(routine)) return 0;
+  CPU6502 start = cpu;
+  save(*before);
+
+  // Native run on the side
+  CPU6502 hle = cpu;
+  native->io.count = 0;
+  io_log = &native->io;
+  hleShadow = true;
+  unsigned int cycles = routine.run(hle);
+  hleShadow = false;
+  io_log = NULL;
+  if (!cycles) return 0;
+  routine.calls++;
+  save(*native);
+  restore(*before);
+
+  // Interpreted run, the one that counts
+  void (*trace)(unsigned int, unsigned char, unsigned char) = cpuBusTrace;
+  interpreted.count = 0;
+  cpuBusTrace = logBus;
+  cpu.traps = false;
+  while (cpu.cycles - start.cycles < cycles && !cpu.stopped) cpuStep(cpu);
+  cpu.traps = true;
+  cpuBusTrace = trace;
+  unsigned int elapsed = cpu.cycles - start.cycles;
+  cpu.cycles = start.cycles;
+
+  bool ok = check(routine, "cycles", start.pc, elapsed, cycles);
+  ok &= check(routine, "PC", start.pc, cpu.pc, hle.pc);
+  ok &= check(routine, "A", start.pc, cpu.a, hle.a);
+  ok &= check(routine, "X", start.pc, cpu.x, hle.x);
+  ok &= check(routine, "Y", start.pc, cpu.y, hle.y);
+  ok &= check(routine, "SP", start.pc, cpu.sp, hle.sp);
+  ok &= check(routine, "P", start.pc, cpu.p, hle.p);
+
+  for (int i = 0; i < RAM_BANK_1_SIZE; i++) {
+    ok &= check(routine, "RAM", RAM_BANK1_ADDR + i, RAM_BANK_1[i], native->ram1[i]);
+  }
+  for (int i = 0; i < RAM_BANK_2_SIZE; i++) {
+    ok &= check(routine, "RAM", RAM_BANK2_ADDR + i, RAM_BANK_2[i], native->ram2[i]);
+  }
+  ok &= check(routine, "KBD", KBD_ADDR, KBD, native->kbd);
+  ok &= check(routine, "KBDCR", KBDCR_ADDR, KBDCR, native->kbdcr);
+  ok &= check(routine, "DSP", DSP_ADDR, DSP, native->dsp);
+  ok &= check(routine, "DSPCR", DSPCR_ADDR, DSPCR, native->dspcr);
+
+  ok &= check(routine, "I/O writes", start.pc, interpreted.count, native->io.count);
+  for (int i = 0; i < interpreted.count && i < native->io.count && i < IO_LOG_SIZE; i++) {
+    ok &= check(routine, "I/O address", start.pc, interpreted.address[i], native->io.address[i]);
+    ok &= check(routine, "I/O data", interpreted.address[i], interpreted.data[i], native->io.data[i]);
+  }
+
+  routine.checked++;
+  if (!ok) routine.mismatches++;
+  return elapsed;
+}
+
+void hleInstall(CPU6502 &cpu, bool verify) {
+  if (verify && !before) {
+    before = (Snapshot *)malloc(sizeof(Snapshot));
+    native = (Snapshot *)malloc(sizeof(Snapshot));
+  }
+  verify = verify && before && native;
+
+  // Code watch: the span of the RAM routines
+  codeWatchStart = 0xFFFF;
+  codeWatchEnd = 0;
+  for (int i = 0; i < HLE_COUNT; i++) {
+    HleRoutine &r = HLE_ROUTINES[i];
+    cpuSetTrap(r.pc, verify ? verifyTrap : trap, &r);
+    if (!r.code) continue;
+    if (r.pc < codeWatchStart) codeWatchStart = r.pc;
+    if (r.pc + r.code_size > codeWatchEnd) codeWatchEnd = r.pc + r.code_size;
+  }
+  codeWatchHit = true;
+  cpu.traps = true;
+}
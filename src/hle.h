@@ -0,0 +1,41 @@
+#ifndef HLE_H
+#define HLE_H
+
+// High level emulation of the hot WOZ monitor & BASIC routines, for the
+// software 65C02 (cpu6502.h traps). Every routine is cycle exact: a run with
+// HLE prints the same output at the same cycle as the interpreter, faster.
+
+#include "cpu6502.h"
+
+// Native version of a routine, as a CpuTrap without the context
+typedef unsigned int (*HleRun)(CPU6502 &cpu);
+
+struct HleRoutine {
+  const char    *name;
+  unsigned int  pc;           // Trap address
+  HleRun        run;          // Native version
+  const unsigned char *code;  // 6502 code it stands in for, checked at pc (NULL: ROM)
+  unsigned int  code_size;
+  bool          code_ok;      // That code is in place, as of the last check
+  unsigned long calls;        // Native runs
+  unsigned long checked;      // Verify mode: runs compared with the interpreter
+  unsigned long mismatches;   // Verify mode: runs that differ
+};
+
+extern HleRoutine HLE_ROUTINES[];
+extern const int HLE_COUNT;
+
+// Set the traps & turn them on for this CPU. With verify, each native run
+// is done on the side and compared with the interpreted one, which is kept.
+void hleInstall(CPU6502 &cpu, bool verify);
+
+// Verify mode: called for every difference. where is the address of a
+// memory / I/O difference, the trap PC otherwise.
+extern void (*hleMismatch)(const HleRoutine &routine, const char *what,
+  unsigned int where, unsigned int expected, unsigned int got);
+
+// True while verify runs a native routine on the side: the display sink
+// drops what it gets, the interpreted run prints it
+extern bool hleShadow;
+
+#endif
@@ -0,0 +1,907 @@
+// Bus trace analyzer (native build)
+//
+// Rebuilds the 6502 instruction stream from a bus trace (trace.h, from the
+// BUS_TRACE sketch or headless -r) and reports where the cycles go: per
+// routine, waiting on KBDCR / DSP, and the hottest loops.
+//
+// There's no SYNC line in the trace: an opcode fetch is the read at the
+// address the previous instruction leads to (fall through, branch / jump
+// target, or the address pulled back by RTS / RTI / JMP (ind) / BRK). The
+// operands are the reads that follow at PC+1, PC+2. Dummy cycles of the
+// real chip, and the repeated cycles the sketch doesn't send, are absorbed
+// by the pattern match. Cycles held on RDY (TRACE_HELD) are skipped. Until the decoder agrees with a few instructions in
+// a row it's out of sync and skips records.
+//
+// Cycles are W65C02S counts from the opcode table, plus taken branches,
+// index page crosses on reads and decimal mode ADC / SBC, as in cpu6502.cpp.
+//
+// The trace is memory mapped and cut in chunks decoded in parallel. Each
+// thread starts a bit before its chunk to get in sync, and only accounts
+// the instructions fetched in its own chunk. Memory use doesn't depend on
+// the trace size. A loop turn is seen only if its start is in the same
+// window, so a few outer turns around chunk edges may be missed.
+//
+// Symbols: code labels of SB-Assembler sources (-a, ASM/woz_monitor.asm if
+// none given) and "ADDR NAME" symbol files (-y).
+//
+// Exit code: 0 OK, 2 usage / input error.
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "../apple1.h"
+#include "../cpu6502.h"
+#include "../trace.h"
+
+//-------------------------------------------------------------------------
+// Symbols
+//-------------------------------------------------------------------------
+
+struct Symbol {
+  unsigned int addr;
+  std::string name;
+  bool operator<(const Symbol &s) const { return addr < s.addr; }
+};
+
+std::vector<Symbol> symbols;    // Code labels, sorted by address
+
+// Just enough of the SB-Assembler to place the labels: instruction sizes,
+// .OR / .EQ / .DA / .AS / .AT / .HS / .BS
+struct Assembler {
+  std::map<std::string, unsigned int> values;
+  const char *path;
+  int line_num;
+  unsigned int pc;
+  bool final_pass;
+
+  // Expression value, false if it uses a label not (yet) defined
+  bool eval(const std::string &expr, unsigned int &value) {
+    value = 0;
+    size_t i = 0;
+    int sign = 1;
+    bool known = true;
+
+    while (i < expr.size()) {
+      unsigned int term = 0;
+      char c = expr[i];
+
+      if (c == '$') {
+        size_t j = ++i;
+        while (i < expr.size() && isxdigit((unsigned char)expr[i])) i++;
+        term = strtoul(expr.substr(j, i - j).c_str(), NULL, 16);
+      } else if (c == '%') {
+        while (++i < expr.size() && (expr[i] == '0' || expr[i] == '1' || expr[i] == '.')) {
+          if (expr[i] != '.') term = term << 1 | (expr[i] - '0');
+        }
+      } else if (isdigit((unsigned char)c)) {
+        size_t j = i;
+        while (i < expr.size() && isdigit((unsigned char)expr[i])) i++;
+        term = strtoul(expr.substr(j, i - j).c_str(), NULL, 10);
+      } else if ((c == '"' || c == '\'') && i + 1 < expr.size()) {
+        term = (unsigned char)expr[i + 1] | (c == '"' ? 0x80 : 0);
+        i += (i + 2 < expr.size() && expr[i + 2] == c) ? 3 : 2;
+      } else if (c == '*') {
+        term = pc;
+        i++;
+      } else if (isalpha((unsigned char)c) || c == '_' || c == '.') {
+        size_t j = i;
+        while (i < expr.size() && (isalnum((unsigned char)expr[i]) || expr[i] == '_' || expr[i] == '.')) i++;
+        std::map<std::string, unsigned int>::iterator it = values.find(expr.substr(j, i - j));
+        if (it != values.end()) term = it->second; else known = false;
+      } else {
+        return false;
+      }
+
+      value = (value + sign * term) & 0xFFFF;
+      if (i >= expr.size()) break;
+      if (expr[i] != '+' && expr[i] != '-') return false;
+      sign = (expr[i++] == '-') ? -1 : 1;
+    }
+
+    return known;
+  }
+
+  static bool hasMode(const std::string &name, int mode) {
+    for (int op = 0; op < 256; op++) {
+      if (OPCODES[op].mode == mode && name == OPCODES[op].name) return true;
+    }
+    return false;
+  }
+
+  static bool endsWith(const std::string &s, const char *end) {
+    size_t len = strlen(end);
+    return s.size() >= len && s.compare(s.size() - len, len, end) == 0;
+  }
+
+  // Addressing mode from the operand syntax, -1 if the mnemonic doesn't have it
+  int mode(const std::string &name, const std::string &operand) {
+    unsigned int value = 0xFFFF;
+    int mode;
+
+    if (operand.empty()) {
+      mode = hasMode(name, AM_ACC) ? AM_ACC : AM_IMP;
+    } else if (operand[0] == '#') {
+      mode = AM_IMM;
+    } else if (operand[0] == '(' && endsWith(operand, ",X)")) {
+      bool zp = eval(operand.substr(1, operand.size() - 4), value) && value < 0x100;
+      mode = (zp && hasMode(name, AM_IZX)) ? AM_IZX : AM_AIX;
+    } else if (operand[0] == '(' && endsWith(operand, "),Y")) {
+      mode = AM_IZY;
+    } else if (operand[0] == '(') {
+      mode = hasMode(name, AM_IND) ? AM_IND : AM_IZP;
+    } else if (hasMode(name, AM_REL)) {
+      mode = AM_REL;
+    } else if (hasMode(name, AM_ZPR)) {
+      mode = AM_ZPR;
+    } else if (endsWith(operand, ",X") || endsWith(operand, ",Y")) {
+      bool x = endsWith(operand, ",X");
+      bool zp = eval(operand.substr(0, operand.size() - 2), value) && value < 0x100;
+      if (x) mode = (zp && hasMode(name, AM_ZPX)) ? AM_ZPX : AM_ABX;
+      else mode = (zp && hasMode(name, AM_ZPY)) ? AM_ZPY : AM_ABY;
+    } else {
+      bool zp = eval(operand, value) && value < 0x100;
+      mode = (zp && hasMode(name, AM_ZP)) ? AM_ZP : AM_ABS;
+    }
+
+    return hasMode(name, mode) ? mode : -1;
+  }
+
+  // Size of a directive, -1 if unknown
+  int directive(const std::string &name, const std::string &operand) {
+    if (name == ".DA") {
+      int size = 0;
+      size_t i = 0;
+      while (i <= operand.size()) {
+        size_t j = operand.find(',', i);
+        if (j == std::string::npos) j = operand.size();
+        size += (operand[i] == '#') ? 1 : 2;
+        i = j + 1;
+      }
+      return size;
+    }
+    if (name == ".AS" || name == ".AT") return operand.size() >= 2 ? operand.size() - 2 : 0;
+    if (name == ".HS") return operand.size() / 2;
+    if (name == ".BS") {
+      unsigned int value;
+      return eval(operand, value) ? (int)value : -1;
+    }
+    return 0;
+  }
+
+  void warn(const char *what, const std::string &text) {
+    if (final_pass) fprintf(stderr, "%s:%d: %s %s\n", path, line_num, what, text.c_str());
+  }
+
+  // Next field of the line, quoted strings kept whole. Columns are counted
+  // with tabs expanded to 8.
+  static std::string field(const std::string &line, size_t &i, int &column) {
+    while (i < line.size() && (line[i] == ' ' || line[i] == '\t')) {
+      column = (line[i] == '\t') ? (column + 8) & ~7 : column + 1;
+      i++;
+    }
+    size_t start = i;
+    char quote = 0;
+    while (i < line.size() && (quote || (line[i] != ' ' && line[i] != '\t'))) {
+      if (line[i] == '"' || line[i] == '\'') quote = (quote == line[i]) ? 0 : (quote ? quote : line[i]);
+      i++;
+    }
+    column += i - start;
+    return line.substr(start, i - start);
+  }
+
+  void pass(FILE *f) {
+    char buf[1024];
+    pc = 0;
+    line_num = 0;
+    rewind(f);
+
+    while (fgets(buf, sizeof(buf), f)) {
+      line_num++;
+      std::string line(buf, strcspn(buf, "\r\n"));
+      if (line.empty() || line[0] == ';' || line[0] == '*') continue;
+
+      size_t i = 0;
+      int column = 0;
+      std::string label;
+      if (line[0] != ' ' && line[0] != '\t') label = field(line, i, column);
+      int name_end;
+      std::string name = field(line, i, column);
+      name_end = column;
+      for (size_t k = 0; k < name.size(); k++) name[k] = toupper((unsigned char)name[k]);
+
+      // Anything far from the mnemonic is the comment of an operand-less line
+      size_t save = i;
+      int save_column = column;
+      std::string operand = field(line, i, column);
+      if (operand.empty() || column - (int)operand.size() - name_end > 8) {
+        operand.clear();
+        i = save;
+        column = save_column;
+      }
+
+      if (name == ".EQ") {
+        unsigned int value;
+        if (eval(operand, value) || final_pass) values[label] = value;
+        continue;
+      }
+      if (name == ".OR") {
+        unsigned int value;
+        if (eval(operand, value)) pc = value;
+        continue;
+      }
+
+      if (!label.empty()) {
+        values[label] = pc;
+        if (final_pass) {
+          Symbol s = {pc, label};
+          symbols.push_back(s);
+        }
+      }
+      if (name.empty()) continue;
+
+      int size;
+      if (name[0] == '.') {
+        size = directive(name, operand);
+        if (size < 0) warn("bad size for", name);
+      } else {
+        int m = mode(name, operand);
+        if (m < 0) {
+          // A comment close to a mnemonic that takes no operand
+          m = mode(name, "");
+          if (m < 0) warn("unknown instruction", name + " " + operand);
+        }
+        size = (m < 0) ? 0 : MODE_SIZE[m];
+      }
+      pc = (pc + (size > 0 ? size : 0)) & 0xFFFF;
+    }
+  }
+};
+
+bool loadAsm(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+
+  // Labels used before their definition are known on the second pass
+  Assembler as;
+  as.path = path;
+  as.final_pass = false;
+  as.pass(f);
+  as.final_pass = true;
+  as.pass(f);
+  fclose(f);
+  return true;
+}
+
+// "ADDR NAME" per line, ADDR in hex ($ optional), ; or # comments
+bool loadSymbols(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+
+  char line[256], name[128];
+  unsigned int addr;
+  int line_num = 0;
+  while (fgets(line, sizeof(line), f)) {
+    line_num++;
+    char *text = line + strspn(line, " \t");
+    if (!*text || strchr(";#\r\n", *text)) continue;
+    if (*text == '$') text++;
+    if (sscanf(text, "%x %127s", &addr, name) != 2) {
+      fprintf(stderr, "%s:%d: bad symbol\n", path, line_num);
+      fclose(f);
+      return false;
+    }
+    Symbol s = {addr & 0xFFFF, name};
+    symbols.push_back(s);
+  }
+
+  fclose(f);
+  return true;
+}
+
+// Nearest label at or below the address, its page if there's none close
+std::string routineName(unsigned int addr) {
+  Symbol key = {addr, ""};
+  std::vector<Symbol>::iterator it = std::upper_bound(symbols.begin(), symbols.end(), key);
+  if (it != symbols.begin() && addr - (--it)->addr < 0x100) return it->name;
+
+  char page[16];
+  snprintf(page, sizeof(page), "$%02Xxx", addr >> 8);
+  return page;
+}
+
+std::string addrName(unsigned int addr) {
+  char text[64];
+  std::string name = routineName(addr);
+  Symbol key = {addr, ""};
+  std::vector<Symbol>::iterator it = std::upper_bound(symbols.begin(), symbols.end(), key);
+  if (name[0] != '$' && it != symbols.begin() && (--it)->addr != addr) {
+    snprintf(text, sizeof(text), "$%04X %s+%u", addr, name.c_str(), addr - it->addr);
+  } else if (name[0] != '$') {
+    snprintf(text, sizeof(text), "$%04X %s", addr, name.c_str());
+  } else {
+    snprintf(text, sizeof(text), "$%04X", addr);
+  }
+  return text;
+}
+
+//-------------------------------------------------------------------------
+// Instruction decode
+//-------------------------------------------------------------------------
+
+enum {
+  FLOW_NEXT,      // Falls through
+  FLOW_BRANCH,    // Fall through or offset
+  FLOW_JUMP,      // Operand is the target (JMP / JSR)
+  FLOW_RTS,       // Pulled from the stack, +1
+  FLOW_RTI,       // Pulled from the stack
+  FLOW_VECTOR,    // Last two reads (JMP (ind), JMP (ind,X), BRK)
+  FLOW_STOP       // STP / WAI, nothing wakes the 6502 up
+};
+
+struct OpInfo {
+  unsigned char flow;
+  unsigned char accesses;   // Bus accesses after the operands, at least
+  bool page_cycle;          // +1 cycle when the index crosses a page
+  bool decimal_cycle;       // +1 cycle in decimal mode
+  bool late_operand;        // Operand bytes interleaved with other accesses
+  bool nop;
+};
+
+OpInfo OPINFO[256];
+
+bool isName(const char *name, const char *list) {
+  char item[8];
+  while (sscanf(list, "%7s", item) == 1) {
+    if (!strcmp(name, item)) return true;
+    list += strspn(list, " ");
+    list += strlen(item);
+  }
+  return false;
+}
+
+void initOpInfo() {
+  for (int op = 0; op < 256; op++) {
+    const Opcode &o = OPCODES[op];
+    OpInfo &info = OPINFO[op];
+    memset(&info, 0, sizeof(info));
+
+    info.nop = !strcmp(o.name, "NOP");
+    bool rmw = isName(o.name, "ASL LSR ROL ROR INC DEC TSB TRB") || !strncmp(o.name, "RMB", 3) ||
+      !strncmp(o.name, "SMB", 3);
+    bool read = isName(o.name, "LDA LDX LDY ADC SBC AND ORA EOR CMP CPX CPY BIT");
+
+    switch (o.mode) {
+      case AM_ZP: case AM_ZPX: case AM_ZPY: case AM_ABS: case AM_ABX: case AM_ABY:
+        info.accesses = 1;
+        break;
+      case AM_IZX: case AM_IZY: case AM_IZP: case AM_IND: case AM_AIX:
+        info.accesses = 3;
+        break;
+    }
+    if (rmw && o.mode != AM_ACC) info.accesses = 2;
+    if (info.nop) info.accesses = 0;
+
+    info.page_cycle = read && (o.mode == AM_ABX || o.mode == AM_ABY || o.mode == AM_IZY);
+    info.decimal_cycle = isName(o.name, "ADC SBC");
+
+    if (o.mode == AM_REL) info.flow = FLOW_BRANCH;
+    if (o.mode == AM_ZPR) {
+      info.flow = FLOW_BRANCH;
+      info.accesses = 1;
+      info.late_operand = true;
+    }
+    if (isName(o.name, "PHA PHP PHX PHY PLA PLP PLX PLY")) info.accesses = 1;
+
+    switch (op) {
+      case 0x4C: info.flow = FLOW_JUMP; info.accesses = 0; break;
+      case 0x20: info.flow = FLOW_JUMP; info.accesses = 2; info.late_operand = true; break;
+      case 0x60: info.flow = FLOW_RTS; info.accesses = 2; break;
+      case 0x40: info.flow = FLOW_RTI; info.accesses = 3; break;
+      case 0x6C: case 0x7C: info.flow = FLOW_VECTOR; info.accesses = 2; break;
+      case 0x00: info.flow = FLOW_VECTOR; info.accesses = 5; break;
+      case 0xCB: case 0xDB: info.flow = FLOW_STOP; break;
+    }
+  }
+}
+
+inline unsigned int recAddr(const TraceRecord &r) { return r.addr_lo | r.addr_hi << 8; }
+inline bool recRead(const TraceRecord &r) { return r.flags & TRACE_READ; }
+
+const unsigned int POLL_GAP = 64;   // Polls closer than this are a wait loop
+const int MAX_ACCESS = 12;    // Bus accesses of an instruction, dummies included
+
+struct Insn {
+  unsigned int pc;
+  unsigned char op;
+  unsigned char bytes[3];
+  size_t next;                // Record of the next opcode fetch
+  unsigned int target;        // Next PC
+  bool taken;                 // Branch / jump / return
+  int naccess;
+  TraceRecord access[MAX_ACCESS];   // Non operand accesses
+};
+
+bool inInsn(const Insn &in, unsigned int addr) {
+  return ((addr - in.pc) & 0xFFFF) < MODE_SIZE[OPCODES[in.op].mode];
+}
+
+// Target of RTS / RTI / JMP (ind) / BRK from the accesses seen so far
+bool dynamicTarget(const Insn &in, unsigned int &target) {
+  const OpInfo &info = OPINFO[in.op];
+  int lo = -1, hi = -1;
+
+  for (int k = in.naccess - 1; k >= 0 && lo < 0; k--) {
+    const TraceRecord &r = in.access[k];
+    if (!recRead(r)) continue;
+    if (info.flow != FLOW_VECTOR && r.addr_hi != 0x01) continue;
+    if (info.flow == FLOW_VECTOR && inInsn(in, recAddr(r))) continue;
+    if (hi < 0) hi = k; else lo = k;
+  }
+  if (lo < 0) return false;
+
+  target = in.access[lo].data | in.access[hi].data << 8;
+  if (info.flow == FLOW_RTS) target = (target + 1) & 0xFFFF;
+  return true;
+}
+
+// Decode the instruction whose opcode fetch is rec[i]. False if the records
+// that follow don't match its bus pattern.
+bool decode(const TraceRecord *rec, size_t i, size_t n, Insn &in) {
+  const TraceRecord &f = rec[i];
+  if (!recRead(f)) return false;
+
+  in.pc = recAddr(f);
+  in.op = f.data;
+  in.bytes[0] = f.data;
+  in.naccess = 0;
+  in.taken = false;
+
+  const Opcode &o = OPCODES[in.op];
+  const OpInfo &info = OPINFO[in.op];
+  unsigned int size = MODE_SIZE[o.mode];
+  size_t j = i + 1;
+
+  // Operands (the headless CPU doesn't read the ones of a NOP)
+  for (unsigned int k = 1; k < size && !info.nop; k++) {
+    unsigned int addr = (in.pc + k) & 0xFFFF;
+    int skipped = 0;
+    while (j < n && !(recRead(rec[j]) && recAddr(rec[j]) == addr)) {
+      if (!info.late_operand || k == 1 || ++skipped > 3) return false;
+      in.access[in.naccess++] = rec[j++];
+    }
+    if (j >= n) return false;
+    in.bytes[k] = rec[j++].data;
+  }
+
+  unsigned int fall = (in.pc + size) & 0xFFFF;
+  unsigned int offset = (o.mode == AM_ZPR) ? in.bytes[2] : in.bytes[1];
+  unsigned int branch = (fall + (signed char)offset) & 0xFFFF;
+  unsigned int jump = in.bytes[1] | in.bytes[2] << 8;
+
+  if (info.flow == FLOW_STOP) {
+    in.next = n;
+    in.target = fall;
+    return true;
+  }
+
+  for (; j < n && in.naccess < MAX_ACCESS; j++) {
+    const TraceRecord &r = rec[j];
+    unsigned int addr = recAddr(r);
+    if (r.flags & TRACE_HELD) continue;
+
+    if (recRead(r) && in.naccess >= info.accesses) {
+      bool match = false;
+      switch (info.flow) {
+        case FLOW_NEXT:
+          match = (addr == fall);
+          break;
+        case FLOW_BRANCH:
+          // A taken branch reads the fall through address first (dummy)
+          if (addr == branch) {
+            match = true;
+          } else if (addr == fall && in.op != 0x80) {
+            match = !(j + 1 < n && recRead(rec[j + 1]) && recAddr(rec[j + 1]) == branch);
+          }
+          break;
+        case FLOW_JUMP:
+          match = (addr == jump);
+          break;
+        default: {
+          unsigned int target;
+          match = dynamicTarget(in, target) && addr == target;
+          break;
+        }
+      }
+
+      if (match) {
+        in.next = j;
+        in.target = addr;
+        in.taken = info.flow != FLOW_BRANCH || in.op == 0x80 || addr != fall;
+        return true;
+      }
+    }
+
+    in.access[in.naccess++] = r;
+  }
+
+  return false;
+}
+
+//-------------------------------------------------------------------------
+// Statistics
+//-------------------------------------------------------------------------
+
+struct LoopStat {
+  unsigned long long count;
+  unsigned long long cycles;
+};
+
+struct Stats {
+  unsigned long long records;
+  unsigned long long skipped;       // Out of sync
+  unsigned long long resyncs;
+  unsigned long long insns;
+  unsigned long long cycles;
+  unsigned long long kbd_wait;      // Polling KBDCR, no key
+  unsigned long long dsp_wait;      // Polling DSP, display busy
+  unsigned long long kbd_polls;
+  unsigned long long dsp_writes;
+  std::vector<unsigned long long> pc_cycles;
+  std::vector<unsigned long long> pc_count;
+  std::unordered_map<unsigned long, LoopStat> loops;  // from << 16 | to
+
+  Stats() : records(0), skipped(0), resyncs(0), insns(0), cycles(0), kbd_wait(0),
+    dsp_wait(0), kbd_polls(0), dsp_writes(0), pc_cycles(0x10000), pc_count(0x10000) {}
+};
+
+// Decoder state that carries over from one instruction to the next
+struct DecodeState {
+  unsigned long long now;       // Cycles so far (this thread)
+  bool decimal;
+  long long kbd_since;          // Last empty KBDCR poll, -1 if none
+  long long dsp_since;          // Last busy DSP poll
+  std::vector<long long> last_seen;   // Cycle of the last fetch at each PC
+
+  DecodeState() : now(0), decimal(false), kbd_since(-1), dsp_since(-1), last_seen(0x10000, -1) {}
+};
+
+unsigned int insnCycles(const Insn &in, bool decimal) {
+  const Opcode &o = OPCODES[in.op];
+  const OpInfo &info = OPINFO[in.op];
+  unsigned int cycles = o.cycles;
+
+  if (info.flow == FLOW_BRANCH && in.taken) {
+    unsigned int fall = (in.pc + MODE_SIZE[o.mode]) & 0xFFFF;
+    cycles += (in.op == 0x80) ? 0 : 1;
+    if ((fall ^ in.target) & 0xFF00) cycles++;
+  }
+
+  if (info.page_cycle) {
+    unsigned int base = 0, ea = 0xFFFFFFFF;
+    int k = 0;
+    if (o.mode == AM_IZY) {
+      if (in.naccess >= 3) {
+        base = in.access[0].data | in.access[1].data << 8;
+        k = 2;
+      }
+    } else {
+      base = in.bytes[1] | in.bytes[2] << 8;
+    }
+    for (; k < in.naccess; k++) {
+      if (!inInsn(in, recAddr(in.access[k]))) {
+        ea = recAddr(in.access[k]);
+        break;
+      }
+    }
+    if (ea != 0xFFFFFFFF && ((base ^ ea) & 0xFF00)) cycles++;
+  }
+
+  if (info.decimal_cycle && decimal) cycles++;
+  return cycles;
+}
+
+// Track D for the ADC / SBC cycle
+void updateDecimal(const Insn &in, bool &decimal) {
+  switch (in.op) {
+    case 0xF8: decimal = true; break;
+    case 0xD8: case 0x00: decimal = false; break;
+    case 0x28: case 0x40:
+      // PLP pulls P, RTI pulls P first
+      for (int k = 0; k < in.naccess; k++) {
+        if (recRead(in.access[k]) && in.access[k].addr_hi == 0x01) {
+          decimal = in.access[k].data & FLAG_D;
+          if (in.op == 0x40) break;
+        }
+      }
+      break;
+  }
+}
+
+void account(const Insn &in, DecodeState &m, Stats &s, bool counted) {
+  unsigned int cycles = insnCycles(in, m.decimal);
+  updateDecimal(in, m.decimal);
+
+  for (int k = 0; k < in.naccess; k++) {
+    const TraceRecord &r = in.access[k];
+    unsigned int addr = recAddr(r);
+
+    // Wait: from a poll that found nothing to the next one, if it comes
+    // right after (BASIC also checks KBDCR once per statement for a break)
+    if (addr == KBDCR_ADDR && recRead(r)) {
+      if (counted && m.kbd_since >= 0 && m.now - m.kbd_since < POLL_GAP) s.kbd_wait += m.now - m.kbd_since;
+      m.kbd_since = (r.data & 0x80) ? -1 : (long long)m.now;
+      if (counted) s.kbd_polls++;
+    } else if (addr == DSP_ADDR && recRead(r)) {
+      if (counted && m.dsp_since >= 0 && m.now - m.dsp_since < POLL_GAP) s.dsp_wait += m.now - m.dsp_since;
+      m.dsp_since = (r.data & 0x80) ? (long long)m.now : -1;
+    } else if (addr == DSP_ADDR && counted) {
+      s.dsp_writes++;
+    }
+  }
+
+  if (counted) {
+    s.insns++;
+    s.cycles += cycles;
+    s.pc_cycles[in.pc] += cycles;
+    s.pc_count[in.pc]++;
+
+    // Backward jump / branch: one more turn of the loop at the target
+    if (in.taken && in.target <= in.pc && m.last_seen[in.target] >= 0) {
+      LoopStat &loop = s.loops[(unsigned long)in.pc << 16 | in.target];
+      loop.count++;
+      loop.cycles += m.now + cycles - m.last_seen[in.target];
+    }
+  }
+
+  m.last_seen[in.pc] = m.now;
+  m.now += cycles;
+}
+
+const int SYNC_RUN = 8;           // Instructions in a row to be in sync
+const size_t WARMUP = 1 << 16;    // Records decoded before a chunk, not counted
+
+// True if the decode from rec[i] holds for SYNC_RUN instructions
+bool inSync(const TraceRecord *rec, size_t i, size_t n) {
+  Insn in;
+  for (int run = 0; run < SYNC_RUN; run++) {
+    if (i >= n) return true;
+    if (!decode(rec, i, n, in)) return false;
+    i = in.next;
+  }
+  return true;
+}
+
+void decodeChunk(const TraceRecord *rec, size_t n, size_t begin, size_t end, Stats &s) {
+  DecodeState m;
+  size_t i = begin > WARMUP ? begin - WARMUP : 0;
+  bool synced = false;
+  bool was_synced = false;
+  Insn in;
+
+  s.records = end - begin;
+
+  while (i < n && i < end) {
+    if (!synced) {
+      if (!inSync(rec, i, n)) {
+        if (i >= begin) s.skipped++;
+        i++;
+        continue;
+      }
+      synced = true;
+      if (was_synced && i >= begin) s.resyncs++;
+      was_synced = true;
+    }
+
+    if (!decode(rec, i, n, in)) {
+      synced = false;
+      if (i >= begin) s.skipped++;
+      i++;
+      continue;
+    }
+
+    account(in, m, s, i >= begin);
+    i = in.next;
+  }
+}
+
+void merge(Stats &to, const Stats &from) {
+  to.records += from.records;
+  to.skipped += from.skipped;
+  to.resyncs += from.resyncs;
+  to.insns += from.insns;
+  to.cycles += from.cycles;
+  to.kbd_wait += from.kbd_wait;
+  to.dsp_wait += from.dsp_wait;
+  to.kbd_polls += from.kbd_polls;
+  to.dsp_writes += from.dsp_writes;
+  for (unsigned int pc = 0; pc < 0x10000; pc++) {
+    to.pc_cycles[pc] += from.pc_cycles[pc];
+    to.pc_count[pc] += from.pc_count[pc];
+  }
+  for (std::unordered_map<unsigned long, LoopStat>::const_iterator it = from.loops.begin();
+       it != from.loops.end(); ++it) {
+    to.loops[it->first].count += it->second.count;
+    to.loops[it->first].cycles += it->second.cycles;
+  }
+}
+
+//-------------------------------------------------------------------------
+// Report
+//-------------------------------------------------------------------------
+
+double percent(unsigned long long part, unsigned long long total) {
+  return total ? 100.0 * part / total : 0;
+}
+
+struct Routine {
+  std::string name;
+  unsigned int addr;
+  unsigned long long cycles;
+  unsigned long long insns;
+  bool operator<(const Routine &r) const { return cycles > r.cycles; }
+};
+
+void report(const Stats &s, size_t top) {
+  printf("%llu records, %llu instructions, %llu cycles\n", s.records, s.insns, s.cycles);
+  printf("%llu records out of sync, %llu resyncs\n\n", s.skipped, s.resyncs);
+
+  // Per routine
+  std::map<std::string, Routine> by_name;
+  for (unsigned int pc = 0; pc < 0x10000; pc++) {
+    if (!s.pc_count[pc]) continue;
+    std::string name = routineName(pc);
+    Routine &r = by_name[name];
+    if (r.name.empty()) {
+      r.name = name;
+      r.addr = pc;
+    }
+    r.cycles += s.pc_cycles[pc];
+    r.insns += s.pc_count[pc];
+  }
+  std::vector<Routine> routines;
+  for (std::map<std::string, Routine>::iterator it = by_name.begin(); it != by_name.end(); ++it) {
+    routines.push_back(it->second);
+  }
+  std::sort(routines.begin(), routines.end());
+
+  printf("%-16s %14s %7s %14s\n", "ROUTINE", "CYCLES", "%", "INSTRUCTIONS");
+  for (size_t k = 0; k < routines.size() && k < top; k++) {
+    printf("%-16s %14llu %6.2f%% %14llu\n", routines[k].name.c_str(), routines[k].cycles,
+      percent(routines[k].cycles, s.cycles), routines[k].insns);
+  }
+
+  // I/O
+  printf("\nKBDCR wait %14llu cycles %6.2f%%  (%llu polls)\n", s.kbd_wait,
+    percent(s.kbd_wait, s.cycles), s.kbd_polls);
+  printf("DSP wait   %14llu cycles %6.2f%%  (%llu chars)\n", s.dsp_wait,
+    percent(s.dsp_wait, s.cycles), s.dsp_writes);
+
+  // Loops
+  std::vector<std::pair<unsigned long long, unsigned long> > loops;
+  for (std::unordered_map<unsigned long, LoopStat>::const_iterator it = s.loops.begin();
+       it != s.loops.end(); ++it) {
+    loops.push_back(std::make_pair(it->second.cycles, it->first));
+  }
+  std::sort(loops.rbegin(), loops.rend());
+
+  printf("\n%-24s %-24s %12s %14s %7s %9s\n", "LOOP", "BACK FROM", "TURNS", "CYCLES", "%", "PER TURN");
+  for (size_t k = 0; k < loops.size() && k < top; k++) {
+    const LoopStat &l = s.loops.find(loops[k].second)->second;
+    printf("%-24s %-24s %12llu %14llu %6.2f%% %9llu\n", addrName(loops[k].second & 0xFFFF).c_str(),
+      addrName(loops[k].second >> 16).c_str(), l.count, l.cycles, percent(l.cycles, s.cycles),
+      l.cycles / l.count);
+  }
+}
+
+void usage() {
+  fprintf(stderr,
+    "usage: analyzer [options] TRACE\n"
+    "  -a FILE   SB-Assembler source for labels (default ASM/woz_monitor.asm)\n"
+    "  -y FILE   symbol file, \"ADDR NAME\" per line\n"
+    "  -j N      decode threads (default: all cores)\n"
+    "  -n N      lines per table (default 20)\n");
+}
+
+int main(int argc, char **argv) {
+  const char *trace_path = NULL;
+  std::vector<const char *> asm_paths;
+  std::vector<const char *> sym_paths;
+  unsigned int threads = std::thread::hardware_concurrency();
+  size_t top = 20;
+
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] != '-') {
+      trace_path = argv[i];
+      continue;
+    }
+    if (!argv[i][1] || argv[i][2] || i + 1 >= argc) {
+      usage();
+      return 2;
+    }
+
+    const char *arg = argv[++i];
+    switch (argv[i-1][1]) {
+      case 'a': asm_paths.push_back(arg); break;
+      case 'y': sym_paths.push_back(arg); break;
+      case 'j': threads = atoi(arg); break;
+      case 'n': top = atoi(arg); break;
+      default:
+        usage();
+        return 2;
+    }
+  }
+
+  if (!trace_path) {
+    usage();
+    return 2;
+  }
+  if (!threads) threads = 1;
+
+  initOpInfo();
+
+  if (asm_paths.empty()) asm_paths.push_back("ASM/woz_monitor.asm");
+  for (size_t k = 0; k < asm_paths.size(); k++) {
+    if (!loadAsm(asm_paths[k])) return 2;
+  }
+  for (size_t k = 0; k < sym_paths.size(); k++) {
+    if (!loadSymbols(sym_paths[k])) return 2;
+  }
+  std::stable_sort(symbols.begin(), symbols.end());
+
+  int fd = open(trace_path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    perror(trace_path);
+    return 2;
+  }
+
+  size_t n = st.st_size / sizeof(TraceRecord);
+  const TraceRecord *rec = NULL;
+  if (n) {
+    void *map = mmap(NULL, n * sizeof(TraceRecord), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      perror(trace_path);
+      return 2;
+    }
+    madvise(map, n * sizeof(TraceRecord), MADV_SEQUENTIAL);
+    rec = (const TraceRecord *)map;
+  }
+
+  // Small traces aren't worth more than one thread
+  if (n / threads < 4 * WARMUP) threads = n / (4 * WARMUP) + 1;
+
+  std::vector<Stats> stats(threads);
+  std::vector<std::thread> workers;
+  for (unsigned int t = 0; t < threads; t++) {
+    size_t begin = n * t / threads;
+    size_t end = n * (t + 1) / threads;
+    workers.push_back(std::thread(decodeChunk, rec, n, begin, end, std::ref(stats[t])));
+  }
+  for (unsigned int t = 0; t < threads; t++) {
+    workers[t].join();
+    if (t) merge(stats[0], stats[t]);
+  }
+
+  report(stats[0], top);
+
+  if (rec) munmap((void *)rec, n * sizeof(TraceRecord));
+  close(fd);
+  return 0;
+}
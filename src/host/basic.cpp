@@ -0,0 +1,404 @@
+// Apple 1 BASIC program import / export (native build)
+//
+// Tokenizes a BASIC listing on the host (intbasic.h) into the program as
+// BASIC keeps it in memory, ready to be loaded in a few milliseconds instead
+// of being typed at 1 MHz through the keyboard:
+//
+//   basic -o prog.ld PROG.BAS     Load stream for the ^B command of the sketch
+//   basic -i prog.bin PROG.BAS    Program image (PP to HIMEM)
+//   headless -b PROG.BAS ...      Loaded straight in the headless RAM
+//
+// Lines go in as typed at the BASIC prompt: a line replaces the one with the
+// same number, a number alone deletes it, blank lines are skipped.
+//
+// -m reads the program from a RAM snapshot instead (file offset = address,
+// as written by headless -m), -l lists it as it has to be typed.
+//
+// -v checks the tokenizer against the BASIC ROM: the listing is typed in the
+// software 65C02, every line must get the same error (or none) and the same
+// tokens, LIST must print what the detokenizer prints, and each line must
+// come back the same from its own listing.
+//
+// A listing with tokenize errors writes neither -o nor -i.
+//
+// Exit code: 0 OK, 1 tokenize error / ROM mismatch, 2 usage.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "../apple1.h"
+#include "../cpu6502.h"
+#include "../intbasic.h"
+
+const unsigned int PROGRAM_MAX = 0x10000;
+const unsigned int TEXT_MAX = 512;          // Listing of a line, LIST form
+
+const unsigned char LOAD_KEY = 0x02;        // ^B, as in the sketch
+
+unsigned char program[PROGRAM_MAX];
+unsigned int program_size = 0;
+
+struct SourceLine {
+  int line_num;           // In the listing
+  std::string text;
+  BasicError error;
+};
+
+std::vector<SourceLine> source;
+
+double elapsedMs(clock_t start) {
+  return (double)(clock() - start) * 1000 / CLOCKS_PER_SEC;
+}
+
+// Tokenize a listing into program. Return the errors.
+unsigned long readListing(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return 1;
+  }
+
+  unsigned long errors = 0;
+  char text[1024];
+  int line_num = 0;
+  while (fgets(text, sizeof(text), f)) {
+    line_num++;
+    text[strcspn(text, "\r\n")] = 0;
+    if (!text[strspn(text, " ")]) continue;
+
+    unsigned char line[BASIC_LINE_MAX];
+    SourceLine src = {line_num, text, BASIC_OK};
+    if (basicTokenize(text, line, src.error)) {
+      if (!basicInsert(program, program_size, PROGRAM_MAX, line)) {
+        fprintf(stderr, "%s:%d: program over %u bytes\n", path, line_num, PROGRAM_MAX);
+        errors++;
+        break;
+      }
+    } else if (errors++ < 10) {
+      fprintf(stderr, "%s:%d: %s: %s\n", path, line_num, basicErrorText(src.error), text);
+    }
+    source.push_back(src);
+  }
+
+  fclose(f);
+  return errors;
+}
+
+// Every line well formed, numbers in order
+bool checkProgram(const unsigned char *prog, unsigned int size) {
+  char text[TEXT_MAX];
+  unsigned int last = 0;
+  for (unsigned int at = 0; at < size; at += prog[at]) {
+    unsigned int number = prog[at + 1] | prog[at + 2] << 8;
+    if (prog[at] < 4 || at + prog[at] > size || (at && number <= last) ||
+      !basicDetokenize(prog + at, prog[at], false, text, sizeof(text))) {
+      fprintf(stderr, "malformed line at offset %u\n", at);
+      return false;
+    }
+    last = number;
+  }
+  return true;
+}
+
+// Program of a RAM snapshot, from PP to HIMEM
+bool readSnapshot(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  static unsigned char ram[PROGRAM_MAX];
+  size_t len = fread(ram, 1, sizeof(ram), f);
+  fclose(f);
+
+  unsigned int pp = ram[BASIC_PP] | ram[BASIC_PP + 1] << 8;
+  unsigned int himem = ram[BASIC_HIMEM] | ram[BASIC_HIMEM + 1] << 8;
+  if (len <= BASIC_PV + 1 || pp > himem || himem > len) {
+    fprintf(stderr, "%s: no BASIC program (PP $%04X, HIMEM $%04X, %lu bytes)\n", path, pp, himem,
+      (unsigned long)len);
+    return false;
+  }
+
+  program_size = himem - pp;
+  memcpy(program, ram + pp, program_size);
+  return checkProgram(program, program_size);
+}
+
+void listProgram(FILE *out) {
+  char text[TEXT_MAX];
+  for (unsigned int at = 0; at < program_size; at += program[at]) {
+    basicDetokenize(program + at, program[at], false, text, sizeof(text));
+    fprintf(out, "%s\n", text);
+  }
+}
+
+bool writeFile(const char *path, const unsigned char *data, unsigned int size, bool stream) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+
+  // Load stream: ^B, size Low, size High, program, 8 bit sum of the program
+  unsigned char sum = 0;
+  for (unsigned int i = 0; i < size; i++) sum += data[i];
+  unsigned char head[3] = {LOAD_KEY, (unsigned char)size, (unsigned char)(size >> 8)};
+
+  bool ok = (!stream || fwrite(head, 1, 3, f) == 3) && fwrite(data, 1, size, f) == size &&
+    (!stream || fputc(sum, f) != EOF);
+  ok = !fclose(f) && ok;
+  if (!ok) perror(path);
+  return ok;
+}
+
+// -- ROM check ---------------------------------------------------------------
+
+const unsigned int GETKEY = 0xE003;   // BASIC key wait loop
+
+std::string output;
+CPU6502 cpu;
+
+void displayWrite(unsigned char dsp) {
+  output += (dsp == CR) ? '\n' : (char)(dsp & 0x7F);
+}
+
+// Type a line (CR added), run until BASIC waits for the next one
+bool typeLine(const std::string &text) {
+  std::string keys = text + '\r';
+  unsigned long limit = cpu.cycles + 100000000UL;
+  size_t i = 0;
+  output.clear();
+
+  while (cpu.cycles < limit) {
+    if (keyboardReady()) {
+      if (i < keys.size()) {
+        keyPress(keys[i++]);
+      } else if (cpu.pc == GETKEY) {
+        return true;
+      }
+    }
+    cpuStep(cpu);
+  }
+  fprintf(stderr, "BASIC doesn't wait for keys after: %s\n", text.c_str());
+  return false;
+}
+
+// Error BASIC printed for the line typed, if any. False if it's not one
+// of the tokenizer (MEM FULL...).
+bool romError(BasicError &error, std::string &message) {
+  error = BASIC_OK;
+  size_t at = output.find("*** ");
+  if (at == std::string::npos) return true;
+
+  message = output.substr(at + 4, output.find_first_of("\r\n", at) - at - 4);
+  for (int e = BASIC_SYNTAX; e <= BASIC_TOO_LONG; e++) {
+    if (message == basicErrorText((BasicError)e)) {
+      error = (BasicError)e;
+      return true;
+    }
+  }
+  return false;
+}
+
+// LIST output, joined back where it goes over the 40 columns (a CR and 6
+// spaces), without the command echo and the CR + prompt after it
+std::string romList() {
+  typeLine("LIST");
+  std::string list;
+  size_t start = output.find('\n') + 1, end = output.rfind('>') - 1;
+  for (size_t i = start; i < end; i++) {
+    if (!output.compare(i, 7, "\n      ")) {
+      i += 6;
+      continue;
+    }
+    list += output[i];
+  }
+  return list;
+}
+
+void mismatch(unsigned long &count, const SourceLine *src, const char *what,
+  const std::string &rom, const std::string &host) {
+  if (count++ < 10) {
+    if (src) fprintf(stderr, "line %d: %s\n", src->line_num, src->text.c_str());
+    fprintf(stderr, "  %s\n  ROM : %s\n  host: %s\n", what, rom.c_str(), host.c_str());
+  }
+}
+
+std::string hex(const unsigned char *data, unsigned int size) {
+  std::string text;
+  char byte[4];
+  for (unsigned int i = 0; i < size; i++) {
+    snprintf(byte, sizeof(byte), "%02X ", data[i]);
+    text += byte;
+  }
+  return text;
+}
+
+unsigned int read16(unsigned int address) {
+  return busRead(address) | busRead(address + 1) << 8;
+}
+
+// Return the mismatches
+unsigned long verify() {
+  unsigned long mismatches = 0;
+
+  loadBASIC();
+  cpuReset(cpu);
+  typeLine("E000R");
+  if (program_size > BASIC_HIMEM_INIT - BASIC_LOMEM_INIT) {
+    char lomem[16];
+    snprintf(lomem, sizeof(lomem), "LOMEM=%u", BASIC_LOMEM_LOW);
+    typeLine(lomem);
+  }
+
+  // Lines BASIC can't take from the keyboard aren't typed
+  unsigned long typed = 0, start_cycles = cpu.cycles;
+  for (size_t i = 0; i < source.size(); i++) {
+    const SourceLine &src = source[i];
+    if (src.error == BASIC_INPUT_LONG || src.error == BASIC_NO_NUMBER) continue;
+    if (!typeLine(src.text)) return mismatches + 1;
+    typed++;
+
+    BasicError error;
+    std::string message;
+    if (!romError(error, message)) {
+      fprintf(stderr, "line %d: %s, check stopped\n", src.line_num, message.c_str());
+      return mismatches + 1;
+    }
+    if (error != src.error) {
+      mismatch(mismatches, &src, "error", basicErrorText(error), basicErrorText(src.error));
+    }
+  }
+  unsigned long type_cycles = cpu.cycles - start_cycles;
+
+  // Same program
+  unsigned int pp = read16(BASIC_PP), himem = read16(BASIC_HIMEM);
+  static unsigned char rom[PROGRAM_MAX];
+  unsigned int rom_size = himem - pp;
+  for (unsigned int i = 0; i < rom_size; i++) rom[i] = busRead(pp + i);
+
+  if (rom_size != program_size || memcmp(rom, program, rom_size)) {
+    // First line that differs
+    unsigned int at = 0;
+    while (at < rom_size && at < program_size && rom[at] == program[at] &&
+      !memcmp(rom + at, program + at, rom[at])) {
+      at += rom[at];
+    }
+    unsigned int rom_len = at < rom_size ? rom[at] : 0, host_len = at < program_size ? program[at] : 0;
+    if (at + rom_len > rom_size) rom_len = rom_size - at;
+    if (at + host_len > program_size) host_len = program_size - at;
+    mismatch(mismatches, NULL, "program", hex(rom + at, rom_len), hex(program + at, host_len));
+  }
+
+  // Same LIST
+  std::string list, rom_list = romList();
+  char text[TEXT_MAX];
+  for (unsigned int at = 0; at < rom_size && rom[at]; at += rom[at]) {
+    basicDetokenize(rom + at, rom[at], true, text, sizeof(text));
+    list += text;
+    list += '\n';
+  }
+  if (list != rom_list) {
+    size_t diff = 0;
+    while (diff < list.size() && diff < rom_list.size() && list[diff] == rom_list[diff]) diff++;
+    size_t line = list.rfind('\n', diff) + 1;
+    mismatch(mismatches, NULL, "LIST", rom_list.substr(line, rom_list.find('\n', line) - line),
+      list.substr(line, list.find('\n', line) - line));
+  }
+
+  // Each line back from its listing
+  for (unsigned int at = 0; at < program_size; at += program[at]) {
+    unsigned char line[BASIC_LINE_MAX];
+    BasicError error;
+    basicDetokenize(program + at, program[at], false, text, sizeof(text));
+    unsigned int size = basicTokenize(text, line, error);
+    if (size != program[at] || memcmp(line, program + at, size)) {
+      mismatch(mismatches, NULL, "round trip", hex(program + at, program[at]), text);
+    }
+  }
+
+  fprintf(stderr, "ROM: %lu lines typed in %lu cycles (%.0f ms at 1 MHz), %lu mismatches\n",
+    typed, type_cycles, type_cycles / 1000.0, mismatches);
+  return mismatches;
+}
+
+void usage() {
+  fprintf(stderr,
+    "usage: basic [options] LISTING\n"
+    "       basic [options] -m SNAPSHOT\n"
+    "  -o FILE   write the load stream for the ^B command of the sketch\n"
+    "  -i FILE   write the program image (PP to HIMEM)\n"
+    "  -m FILE   read the program from a RAM snapshot (offset = address)\n"
+    "  -l        list the program to stdout\n"
+    "  -v        check the tokenizer against the BASIC ROM\n");
+}
+
+int main(int argc, char **argv) {
+  const char *listing_path = NULL;
+  const char *snapshot_path = NULL;
+  const char *stream_path = NULL;
+  const char *image_path = NULL;
+  bool list = false;
+  bool rom_check = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] != '-') {
+      listing_path = argv[i];
+      continue;
+    }
+    if (!strcmp(argv[i], "-l")) {
+      list = true;
+      continue;
+    }
+    if (!strcmp(argv[i], "-v")) {
+      rom_check = true;
+      continue;
+    }
+    if (!argv[i][1] || argv[i][2] || i + 1 >= argc) {
+      usage();
+      return 2;
+    }
+
+    const char *arg = argv[++i];
+    switch (argv[i-1][1]) {
+      case 'o': stream_path = arg; break;
+      case 'i': image_path = arg; break;
+      case 'm': snapshot_path = arg; break;
+      default:
+        usage();
+        return 2;
+    }
+  }
+
+  if (!listing_path == !snapshot_path || (rom_check && !listing_path)) {
+    usage();
+    return 2;
+  }
+
+  clock_t start = clock();
+  unsigned long errors = 0;
+  if (snapshot_path) {
+    if (!readSnapshot(snapshot_path)) return 1;
+  } else {
+    errors = readListing(listing_path);
+    fprintf(stderr, "%lu lines, %u bytes tokenized in %.2f ms, %lu errors\n",
+      (unsigned long)source.size(), program_size, elapsedMs(start), errors);
+  }
+
+  if (list) listProgram(stdout);
+
+  // No load stream / image of a listing with lines missing
+  if (errors && (stream_path || image_path)) {
+    fprintf(stderr, "%s not written\n", stream_path && image_path ? "load stream & image" :
+      stream_path ? "load stream" : "image");
+  } else {
+    if (stream_path && !writeFile(stream_path, program, program_size, true)) return 2;
+    if (image_path && !writeFile(image_path, program, program_size, false)) return 2;
+  }
+
+  if (rom_check) errors += verify();
+  return errors ? 1 : 0;
+}
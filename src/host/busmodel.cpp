@@ -0,0 +1,376 @@
+// Bus protocol model (native build)
+//
+// Replays a bus trace (trace.h, from headless -r or the BUS_TRACE sketch)
+// through three timing models of the Due bus handler:
+//
+//   fixed : the original loop. Every cycle pays the clock delay, the pot
+//           read and the keyboard poll, a DSP write blocks in Serial.write
+//   rdy   : the first RDY sketch. Every cycle still pays the clock delay and
+//           the pot read, the keyboard is polled on KBDCR reads only, and
+//           the 6502 is held on RDY (clock still running) while the serial
+//           output buffer has no room
+//   sched : as rdy, with the pot read and the keyboard polled by the
+//           scheduler (scheduler.h) instead of on every cycle / KBDCR read
+//
+// All three run with the pot at the same position (-d, 0 by default: the
+// clock as fast as the sketch).
+//
+// The models take the RDY decisions of the sketch (isIOAccess / ioMustWait
+// in apple1.h). The RDY the sketch actually drove is in the TRACE_HELD
+// records of a BUS_TRACE trace, and is checked against the protocol rules:
+//   - RDY goes Low only on an access that may wait (a DSP write)
+//   - the held cycle is served, with RDY back High, before the next one
+// and against the UART drain model, with the costs of the BUS_TRACE sketch
+// (sched, no pot): the output buffer is full when a stall starts, the stall ends
+// when the UART made room, no write goes to a full buffer. The drain model gets in step with the sketch
+// on each stall that ends (RDY went High on a char leaving the UART), the
+// first one included (the banner may still be in the buffer before that).
+// From there the costs may be off by COST_SLACK, plus a char time.
+// A headless trace has no RDY, only the models run.
+//
+// Costs are in microseconds. Defaults are estimates for a Due running the
+// sketch (digitalWrite / digitalRead based), not measurements: pass the
+// ones measured on your board to get real numbers.
+//
+// Exit code: 0 OK, 1 protocol violation, 2 usage.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../apple1.h"
+#include "../trace.h"
+
+const double COST_SLACK = 0.25;   // Cost estimate error the drain checks allow
+const double POT_PERIOD = 20000;  // us, pot read by the scheduler (main.cpp)
+
+struct Costs {
+  double cycle;     // Clock toggle + address / R/W read + data bus
+  double delay;     // CLOCK_DELAY, paid twice per cycle
+  double pot;       // analogRead of the clock pot
+  double poll;      // Serial.available()
+  int poll_every;   // Cycles between two keyboard polls (sched)
+  double io;        // Extra work for an I/O access (PIA / block device)
+  double baud;      // Serial speed
+  int tx_size;      // Serial output buffer
+};
+
+// Serial output: chars leave the buffer one every char_time
+struct Uart {
+  double char_time;
+  int size;
+  int count;          // Chars in the buffer
+  double next_done;   // When the first one is out
+  int max_count;
+
+  void drain(double now) {
+    while (count > 0 && next_done <= now) {
+      count--;
+      next_done += char_time;
+    }
+  }
+
+  void push(double now) {
+    if (count == 0) next_done = now + char_time;
+    count++;
+    if (count > max_count) max_count = count;
+  }
+
+  int room() const { return size - count; }
+
+  // A char just left and made room for n
+  void madeRoom(int n, double now) {
+    count = size - n;
+    next_done = now + char_time;
+  }
+
+  // When there's room for n chars, drained up to now
+  double roomTime(int n, double now) const {
+    return room() >= n ? now : next_done + (n - room() - 1) * char_time;
+  }
+};
+
+struct Stats {
+  unsigned long cycles;
+  unsigned long io;
+  unsigned long dsp;
+  unsigned long held;       // Cycles the 6502 spent on RDY
+  unsigned long stalls;     // RDY Low periods
+  double time;              // us
+  double blocked;           // us spent blocked on output
+  double max_stall;         // us, longest RDY Low period
+  double next_pot;          // us, next pot read (sched)
+};
+
+// RDY Low period of the trace being replayed
+struct Stall {
+  bool on;
+  unsigned int address;
+  bool read;
+  double start;             // us, BUS_TRACE sketch costs
+  double ready;             // us, room in the buffer by the drain model
+  unsigned long cycles;
+};
+
+struct Model {
+  Costs c;
+  Uart fixed_tx, rdy_tx, sched_tx, trace_tx;
+  Stats fixed, rdy, sched, trace;
+  Stall stall;
+  bool in_step;             // Drain model in step with the sketch
+  double step_time;         // us, when it got in step
+  unsigned long max_held;   // Cycles, longest recorded stall
+  unsigned long violations;
+
+  void violation(unsigned long n, const char *what, unsigned int address) {
+    if (violations++ < 10) fprintf(stderr, "cycle %lu: $%04X %s\n", n, address, what);
+  }
+
+  // Chars displayWrite() sends for this DSP value
+  static int dspChars(unsigned char data) {
+    return ((data & 0x7F) == (CR & 0x7F)) ? 2 : 1;
+  }
+
+  void stepFixed(unsigned int address, unsigned char data, bool read) {
+    fixed.cycles++;
+    fixed.time += c.cycle + 2 * c.delay + c.pot + c.poll;
+    if (!isIOAccess(address)) return;
+
+    fixed.io++;
+    fixed.time += c.io;
+    if (read || address != DSP_ADDR) return;
+
+    // Serial.write blocks until there's room for each char
+    fixed.dsp++;
+    for (int i = dspChars(data); i > 0; i--) {
+      fixed_tx.drain(fixed.time);
+      if (!fixed_tx.room()) {
+        fixed.blocked += fixed_tx.next_done - fixed.time;
+        fixed.time = fixed_tx.next_done;
+        fixed_tx.drain(fixed.time);
+      }
+      fixed_tx.push(fixed.time);
+    }
+  }
+
+  // Clock & pot of a cycle, held ones included
+  double cycleTime(Stats &rdy, bool scheduled) {
+    double time = c.cycle + 2 * c.delay;
+    if (!scheduled) return time + c.pot;
+    if (rdy.time >= rdy.next_pot) {
+      rdy.next_pot += POT_PERIOD;
+      time += c.pot;
+    }
+    return time;
+  }
+
+  // scheduled: pot & keyboard polled by the scheduler, else the pot is read
+  // every cycle and the keyboard polled on each KBDCR read
+  void stepRdy(Stats &rdy, Uart &rdy_tx, bool scheduled, unsigned int address, unsigned char data,
+    bool read) {
+    rdy.cycles++;
+    rdy.time += cycleTime(rdy, scheduled);
+    if (scheduled && !(rdy.cycles % c.poll_every)) rdy.time += c.poll;
+    if (!isIOAccess(address)) return;
+
+    rdy.io++;
+    rdy.time += c.io;
+    if (!scheduled && address == KBDCR_ADDR) rdy.time += c.poll;
+
+    rdy_tx.drain(rdy.time);
+    if (ioMustWait(address, read, rdy_tx.room())) {
+      // RDY Low: the 6502 repeats this cycle, the clock keeps running
+      double start = rdy.time;
+      rdy.stalls++;
+      while (ioMustWait(address, read, rdy_tx.room())) {
+        rdy.held++;
+        rdy.time += cycleTime(rdy, scheduled);
+        rdy_tx.drain(rdy.time);
+      }
+      // RDY High again on this very cycle, it's served below
+      double stall = rdy.time - start;
+      rdy.blocked += stall;
+      if (stall > rdy.max_stall) rdy.max_stall = stall;
+    }
+
+    if (read || address != DSP_ADDR) return;
+
+    rdy.dsp++;
+    for (int i = dspChars(data); i > 0; i--) rdy_tx.push(rdy.time);
+  }
+
+  // RDY as recorded: timed as the BUS_TRACE sketch (no pot), the stalls are
+  // the ones of the trace instead of the model's own
+  void stepTrace(unsigned long n, unsigned int address, unsigned char data, bool read, bool held) {
+    if (stall.on && (address != stall.address || read != stall.read)) {
+      violation(n, "held cycle not served next", stall.address);
+      stall.on = false;
+    }
+
+    double cost = c.cycle + (isIOAccess(address) ? c.io : 0);
+    trace_tx.drain(trace.time);
+
+    // How far off the drain model may be by now, in us & in chars
+    double slack = trace_tx.char_time + COST_SLACK * (trace.time - step_time);
+    int slack_chars = (int)(slack / trace_tx.char_time);
+
+    if (held) {
+      if (!stall.on) {
+        if (!ioMustWait(address, read, 0)) violation(n, "RDY Low on an access that never waits", address);
+        if (in_step && !ioMustWait(address, read, trace_tx.room() - slack_chars)) {
+          violation(n, "RDY Low with room in the output buffer", address);
+        }
+        Stall s = {true, address, read, trace.time, trace_tx.roomTime(2, trace.time), 0};
+        stall = s;
+        trace.stalls++;
+      }
+      stall.cycles++;
+      trace.held++;
+      trace.time += cost;
+      return;
+    }
+
+    if (stall.on) {
+      stall.on = false;
+      double late = trace.time - stall.ready;
+      double late_max = trace_tx.char_time + COST_SLACK * (stall.ready - step_time);
+      bool on_time = !in_step || (late <= late_max && late >= -late_max);
+      if (in_step && late > late_max) violation(n, "held after the UART made room", address);
+      if (in_step && late < -late_max) violation(n, "released before the UART made room", address);
+      if (stall.cycles > max_held) max_held = stall.cycles;
+      if (trace.time - stall.start > trace.max_stall) trace.max_stall = trace.time - stall.start;
+
+      // RDY went High on a char leaving the UART, the one that made room for
+      // the held write: in step with the sketch from there. Out of step, the
+      // model time is the best guess of when that was. Off the rules, there's
+      // no telling: back in step on the next stall.
+      if (on_time) {
+        if (in_step) trace.time = stall.ready;
+        trace_tx.madeRoom(2, trace.time);
+        step_time = trace.time;
+      }
+      in_step = on_time;
+    }
+
+    trace.cycles++;
+    trace.time += cost;
+    if (!(trace.cycles % c.poll_every)) trace.time += c.poll;
+
+    if (read || address != DSP_ADDR) return;
+
+    // No room: the sketch wrote without holding the 6502 first
+    trace.dsp++;
+    for (int i = dspChars(data); i > 0; i--) {
+      if (in_step && trace_tx.room() + slack_chars <= 0) violation(n, "output buffer overflow", address);
+      trace_tx.push(trace.time);
+    }
+  }
+};
+
+void report(const char *name, const Stats &s) {
+  printf("%-6s %12.0f us  %8.3f MHz  output blocked %10.0f us\n", name, s.time,
+    s.time > 0 ? s.cycles / s.time : 0, s.blocked);
+}
+
+void usage() {
+  fprintf(stderr,
+    "usage: busmodel [options] TRACE\n"
+    "  -c US     handler cost of a cycle (default 2.5)\n"
+    "  -d US     CLOCK_DELAY, the pot position (default 0)\n"
+    "  -a US     analogRead cost (default 4)\n"
+    "  -p US     Serial.available cost (default 0.5)\n"
+    "  -k N      cycles between two keyboard polls of sched (default 64)\n"
+    "  -i US     extra cost of an I/O access (default 1)\n"
+    "  -b BAUD   serial speed (default 115200)\n"
+    "  -x N      serial output buffer size (default 128)\n");
+}
+
+int main(int argc, char **argv) {
+  Costs c = {2.5, 0, 4, 0.5, 64, 1, 115200, 128};
+  const char *trace_path = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] != '-') {
+      trace_path = argv[i];
+      continue;
+    }
+    if (!argv[i][1] || argv[i][2] || i + 1 >= argc) {
+      usage();
+      return 2;
+    }
+
+    double val = atof(argv[++i]);
+    switch (argv[i-1][1]) {
+      case 'c': c.cycle = val; break;
+      case 'd': c.delay = val; break;
+      case 'a': c.pot = val; break;
+      case 'p': c.poll = val; break;
+      case 'k': c.poll_every = (int)val; break;
+      case 'i': c.io = val; break;
+      case 'b': c.baud = val; break;
+      case 'x': c.tx_size = (int)val; break;
+      default:
+        usage();
+        return 2;
+    }
+  }
+
+  if (!trace_path || c.cycle <= 0 || c.baud <= 0 || c.tx_size < 2 || c.poll_every < 1) {
+    usage();
+    return 2;
+  }
+
+  FILE *f = fopen(trace_path, "rb");
+  if (!f) {
+    perror(trace_path);
+    return 2;
+  }
+
+  Model m;
+  memset(&m, 0, sizeof(m));
+  m.c = c;
+  Uart tx = {10 * 1e6 / c.baud, c.tx_size, 0, 0, 0};   // 8N1
+  m.fixed_tx = tx;
+  m.rdy_tx = tx;
+  m.sched_tx = tx;
+  m.trace_tx = tx;
+
+  // Traces get big, stream them
+  static TraceRecord buf[4096];
+  unsigned long n = 0;
+  size_t len;
+  while ((len = fread(buf, sizeof(TraceRecord), 4096, f)) > 0) {
+    for (size_t i = 0; i < len; i++, n++) {
+      unsigned int address = buf[i].addr_lo | buf[i].addr_hi << 8;
+      bool read = buf[i].flags & TRACE_READ;
+      bool held = buf[i].flags & TRACE_HELD;
+
+      m.stepTrace(n, address, buf[i].data, read, held);
+      if (held) continue;   // The models hold the 6502 their own way
+      m.stepFixed(address, buf[i].data, read);
+      m.stepRdy(m.rdy, m.rdy_tx, false, address, buf[i].data, read);
+      m.stepRdy(m.sched, m.sched_tx, true, address, buf[i].data, read);
+    }
+  }
+  fclose(f);
+
+  printf("%lu cycles, %lu I/O, %lu DSP writes\n", m.rdy.cycles, m.rdy.io, m.rdy.dsp);
+  report("fixed", m.fixed);
+  report("rdy", m.rdy);
+  report("sched", m.sched);
+  printf("RDY: %lu stalls, %lu held cycles, longest %.0f us, buffer peak %d/%d\n",
+    m.rdy.stalls, m.rdy.held, m.rdy.max_stall, m.rdy_tx.max_count, c.tx_size);
+  if (m.trace.stalls) {
+    printf("RDY recorded: %lu stalls, %lu held cycles, longest %lu cycles (%.0f us)\n",
+      m.trace.stalls, m.trace.held, m.max_held, m.trace.max_stall);
+  } else {
+    printf("RDY recorded: none in the trace\n");
+  }
+  if (m.rdy.time > 0) printf("rdy vs fixed x%.2f\n", m.fixed.time / m.rdy.time);
+  if (m.sched.time > 0) printf("sched vs fixed x%.2f\n", m.fixed.time / m.sched.time);
+
+  if (m.violations) {
+    fprintf(stderr, "%lu RDY protocol violations\n", m.violations);
+    return 1;
+  }
+  return 0;
+}
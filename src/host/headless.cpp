@@ -0,0 +1,409 @@
+// Headless Apple 1 (native build, no Arduino / no 6502 chip)
+//
+// Runs the software 65C02 against the same memory map & PIA used by the
+// sketch. Keys are replayed from a script through KBD / KBDCR, DSP output is
+// captured to a file. The run ends when the expected output shows up, on a
+// cycle limit or on a (wall clock) timeout.
+//
+// Script format, one line = one input line (a CR is sent at the end):
+//
+//   E000R              Typed as soon as the 6502 read the previous key
+//   @1500000 PRINT 1   Not before cycle 1500000, then as above
+//   @?>                Hold the next line until the output ends with ">"
+//   @@LIST             A line starting with "@" ("@@" escapes it)
+//   @# comment         Ignored
+//
+// Escapes: \\ backslash, \e ESC, \xHH any char, a trailing \ means no CR.
+//
+// With -H the hot ROM / BASIC routines run natively (hle.h), cycle exact:
+// same output, same cycle counts. -V runs them both ways and reports any
+// difference between the native and the interpreted result.
+//
+// -b FILE tokenizes a BASIC listing (intbasic.h) and loads it in the RAM
+// before the run, the script enters BASIC with a warm start (E2B3R, E000R
+// would clear it). -m FILE saves the RAM at the end, for basic -m.
+//
+// Exit code: 0 OK, 1 expected output not found / golden mismatch / HLE
+// mismatch, 2 usage.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "../apple1.h"
+#include "../cpu6502.h"
+#include "../hle.h"
+#include "../intbasic.h"
+#include "../scheduler.h"
+#include "../blockdev.h"
+#include "../trace.h"
+
+struct ScriptKey {
+  unsigned long cycle;  // Not before this cycle
+  std::string wait;     // Not before the output ends with this
+  char key;
+};
+
+std::vector<ScriptKey> script;
+std::string output;         // Everything written to DSP
+FILE *output_file = NULL;
+const char *expect = NULL;  // Stop as soon as the output ends with this
+bool matched = false;
+FILE *trace_file = NULL;    // Bus trace (trace.h), busmodel input
+
+void traceCycle(unsigned int address, unsigned char data, unsigned char flags) {
+  TraceRecord rec = {(unsigned char)address, (unsigned char)(address >> 8), data, flags};
+  fwrite(&rec, sizeof(rec), 1, trace_file);
+}
+
+bool outputEndsWith(const std::string &text) {
+  return output.size() >= text.size() &&
+    output.compare(output.size() - text.size(), text.size(), text) == 0;
+}
+
+void displayWrite(unsigned char dsp) {
+  if (hleShadow) return;
+
+  char c = (dsp == CR) ? '\n' : (dsp & 0x7F);
+
+  output += c;
+  if (output_file) fputc(c, output_file);
+
+  if (expect && outputEndsWith(expect)) matched = true;
+}
+
+// Decode a script line into keys. Return false on a malformed escape.
+bool parseLine(const char *line, unsigned long cycle, std::string wait) {
+  bool send_cr = true;
+
+  for (const char *c = line; *c; c++) {
+    char key = *c;
+
+    if (key == '\\') {
+      switch (*++c) {
+        case '\\': key = '\\'; break;
+        case 'e':  key = 0x1B; break;
+        case 'x': {
+          char hex[3] = {0, 0, 0};
+          if (!c[1] || !c[2]) return false;
+          hex[0] = c[1];
+          hex[1] = c[2];
+          key = (char)strtol(hex, NULL, 16);
+          c += 2;
+          break;
+        }
+        case 0:
+          send_cr = false;
+          c--;
+          continue;
+        default:
+          return false;
+      }
+    }
+
+    ScriptKey k = {cycle, wait, key};
+    script.push_back(k);
+    cycle = 0;
+    wait.clear();
+  }
+
+  if (send_cr) {
+    ScriptKey k = {cycle, wait, '\r'};
+    script.push_back(k);
+  }
+
+  return true;
+}
+
+bool loadScript(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+
+  char line[1024];
+  int line_num = 0;
+  std::string wait;
+  while (fgets(line, sizeof(line), f)) {
+    line_num++;
+    line[strcspn(line, "\r\n")] = 0;
+
+    unsigned long cycle = 0;
+    char *text = line;
+
+    if (line[0] == '@') {
+      if (line[1] == '#') continue;
+      if (line[1] == '?') {
+        wait = line + 2;
+        continue;
+      }
+      if (line[1] == '@') {
+        text = line + 1;
+      } else {
+        cycle = strtoul(line + 1, &text, 10);
+        if (*text == ' ') text++;
+      }
+    }
+
+    if (!parseLine(text, cycle, wait)) {
+      fprintf(stderr, "%s:%d: bad escape\n", path, line_num);
+      fclose(f);
+      return false;
+    }
+    wait.clear();
+  }
+
+  fclose(f);
+  return true;
+}
+
+void hleReport(const HleRoutine &routine, const char *what, unsigned int where,
+  unsigned int expected, unsigned int got) {
+  fprintf(stderr, "HLE %s $%04X: %s $%04X, interpreted $%02X, native $%02X\n",
+    routine.name, routine.pc, what, where, expected, got);
+}
+
+// Wall clock, as micros() on the Due
+typedef std::chrono::steady_clock WallClock;
+
+uint32_t hostMicros() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+    WallClock::now().time_since_epoch()).count();
+}
+
+bool readFile(const char *path, std::string &data) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+
+  char buf[4096];
+  size_t len;
+  while ((len = fread(buf, 1, sizeof(buf), f)) > 0) {
+    data.append(buf, len);
+  }
+  fclose(f);
+  return true;
+}
+
+// Tokenize a BASIC listing, load it under HIMEM
+bool loadListing(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+
+  static unsigned char program[RAM_BANK_1_SIZE];
+  unsigned int size = 0;
+  char text[1024];
+  int line_num = 0;
+  while (fgets(text, sizeof(text), f)) {
+    line_num++;
+    text[strcspn(text, "\r\n")] = 0;
+    if (!text[strspn(text, " ")]) continue;
+
+    unsigned char line[BASIC_LINE_MAX];
+    BasicError error;
+    if (!basicTokenize(text, line, error) || !basicInsert(program, size, sizeof(program), line)) {
+      fprintf(stderr, "%s:%d: %s\n", path, line_num, error ? basicErrorText(error) : "program too big");
+      fclose(f);
+      return false;
+    }
+  }
+  fclose(f);
+
+  basicMakeRoom(size);
+  if (!basicLoad(program, size)) {
+    fprintf(stderr, "%s: %u bytes, no room under HIMEM\n", path, size);
+    return false;
+  }
+  fprintf(stderr, "%s: %u bytes at $%04X\n", path, size, basicLoadAddress(size));
+  return true;
+}
+
+bool writeSnapshot(const char *path) {
+  FILE *f = fopen(path, "wb");
+  if (!f || fwrite(RAM_BANK_1, 1, RAM_BANK_1_SIZE, f) != (size_t)RAM_BANK_1_SIZE) {
+    perror(path);
+    if (f) fclose(f);
+    return false;
+  }
+  return !fclose(f);
+}
+
+// Wall clock limit, checked every TIMEOUT_PERIOD cycles
+const uint32_t TIMEOUT_PERIOD = 1UL << 18;
+WallClock::time_point deadline;
+bool timed_out = false;
+
+void checkTimeout() {
+  if (WallClock::now() > deadline) timed_out = true;
+}
+
+void usage() {
+  fprintf(stderr,
+    "usage: headless [options]\n"
+    "  -s FILE   keystroke script\n"
+    "  -o FILE   write DSP output to FILE (- for stdout)\n"
+    "  -e TEXT   stop with success as soon as the output ends with TEXT\n"
+    "  -g FILE   compare the whole output with FILE at the end\n"
+    "  -d FILE   disk image for the block device (created if missing)\n"
+    "  -r FILE   record every bus cycle to FILE (see trace.h)\n"
+    "  -b FILE   load a BASIC listing before the run (enter BASIC with E2B3R)\n"
+    "  -m FILE   save the RAM ($0000-$0FFF) to FILE at the end\n"
+    "  -H        run the hot ROM / BASIC routines natively\n"
+    "  -V        as -H, and check each run against the interpreter\n"
+    "  -c N      stop after N emulated cycles\n"
+    "  -t SEC    stop after SEC seconds of wall clock (default 10)\n");
+}
+
+int main(int argc, char **argv) {
+  const char *script_path = NULL;
+  const char *output_path = NULL;
+  const char *golden_path = NULL;
+  const char *listing_path = NULL;
+  const char *snapshot_path = NULL;
+  unsigned long max_cycles = 0;
+  double timeout = 10;
+  bool hle = false;
+  bool hle_verify = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-H")) {
+      hle = true;
+      continue;
+    }
+    if (!strcmp(argv[i], "-V")) {
+      hle = hle_verify = true;
+      continue;
+    }
+    if (argv[i][0] != '-' || !argv[i][1] || argv[i][2] || i + 1 >= argc) {
+      usage();
+      return 2;
+    }
+
+    const char *arg = argv[++i];
+    switch (argv[i-1][1]) {
+      case 's': script_path = arg; break;
+      case 'o': output_path = arg; break;
+      case 'e': expect = arg; break;
+      case 'g': golden_path = arg; break;
+      case 'd':
+        if (!blockDevOpen(arg)) {
+          perror(arg);
+          return 2;
+        }
+        break;
+      case 'r':
+        trace_file = fopen(arg, "wb");
+        if (!trace_file) {
+          perror(arg);
+          return 2;
+        }
+        setvbuf(trace_file, NULL, _IOFBF, 1 << 16);
+        cpuBusTrace = traceCycle;
+        break;
+      case 'b': listing_path = arg; break;
+      case 'm': snapshot_path = arg; break;
+      case 'c': max_cycles = strtoul(arg, NULL, 10); break;
+      case 't': timeout = atof(arg); break;
+      default:
+        usage();
+        return 2;
+    }
+  }
+
+  // Native routines skip their bus cycles, the trace would miss them
+  if (hle && trace_file) {
+    fprintf(stderr, "-H / -V can't record a bus trace\n");
+    return 2;
+  }
+
+  if (script_path && !loadScript(script_path)) return 2;
+
+  std::string golden;
+  if (golden_path && !readFile(golden_path, golden)) return 2;
+
+  if (output_path) {
+    output_file = strcmp(output_path, "-") ? fopen(output_path, "w") : stdout;
+    if (!output_file) {
+      perror(output_path);
+      return 2;
+    }
+  }
+
+  loadBASIC();
+  loadPROG();
+  if (listing_path && !loadListing(listing_path)) return 2;
+
+  CPU6502 cpu;
+  cpuReset(cpu);
+  if (hle) {
+    hleMismatch = hleReport;
+    hleInstall(cpu, hle_verify);
+  }
+
+  // Housekeeping every so many cycles (scheduler.h)
+  schedMicros = hostMicros;
+  schedStart();
+  schedAdd("timeout", checkTimeout, SCHED_CYCLES, TIMEOUT_PERIOD);
+
+  size_t next_key = 0;
+  WallClock::time_point start = WallClock::now();
+  deadline = start + std::chrono::duration_cast<WallClock::duration>(std::chrono::duration<double>(timeout));
+
+  while (!matched && !timed_out) {
+    // Next key goes in only once the 6502 read the previous one
+    if (next_key < script.size() && keyboardReady()) {
+      const ScriptKey &k = script[next_key];
+      if (cpu.cycles >= k.cycle && (k.wait.empty() || outputEndsWith(k.wait))) {
+        keyPress(k.key);
+        next_key++;
+      }
+    }
+
+    schedTick(cpuStep(cpu));
+
+    if (max_cycles && cpu.cycles >= max_cycles) break;
+  }
+
+  double elapsed = std::chrono::duration<double>(WallClock::now() - start).count();
+  if (output_file && output_file != stdout) fclose(output_file);
+  if (trace_file) fclose(trace_file);
+  if (snapshot_path && !writeSnapshot(snapshot_path)) return 2;
+
+  fprintf(stderr, "%lu cycles in %.3f s (%.2f MHz)%s\n", cpu.cycles, elapsed,
+    elapsed > 0 ? cpu.cycles / elapsed / 1e6 : 0, timed_out ? ", timeout" : "");
+
+  unsigned long mismatches = 0;
+  for (int i = 0; hle && i < HLE_COUNT; i++) {
+    const HleRoutine &r = HLE_ROUTINES[i];
+    if (!r.calls) continue;
+    fprintf(stderr, "HLE %-8s %10lu calls", r.name, r.calls);
+    if (hle_verify) fprintf(stderr, ", %lu checked, %lu mismatches", r.checked, r.mismatches);
+    fprintf(stderr, "\n");
+    mismatches += r.mismatches;
+  }
+
+  if (expect && !matched) {
+    fprintf(stderr, "expected output not found\n");
+    return 1;
+  }
+
+  if (golden_path && output != golden) {
+    fprintf(stderr, "output differs from %s\n", golden_path);
+    return 1;
+  }
+
+  if (mismatches) {
+    fprintf(stderr, "%lu HLE mismatches\n", mismatches);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,625 @@
+#include <string.h>
+#include "intbasic.h"
+#include "apple1.h"
+
+// The tokenizer follows the syntax of the BASIC ROM: spaces are ignored
+// outside strings & REM (even inside keywords and numbers), keywords are
+// tried before variables, alternatives are tried in the ROM order and the
+// token of a separator depends on what comes after it.
+
+const char *basicErrorText(BasicError error) {
+  switch (error) {
+    case BASIC_OK:         return "OK";
+    case BASIC_SYNTAX:     return "SYNTAX ERR";
+    case BASIC_RANGE:      return ">32767 ERR";
+    case BASIC_TOO_LONG:   return "TOO LONG ERR";
+    case BASIC_NO_NUMBER:  return "no line number";
+    case BASIC_INPUT_LONG: return "line over 127 chars";
+  }
+  return "?";
+}
+
+// -- Tokenizer ---------------------------------------------------------------
+
+struct Parser {
+  const char    *src;
+  unsigned int  pos;
+  unsigned char *out;
+  unsigned int  n;          // Bytes in out, size & number included
+  BasicError    error;      // Stops the parse, no way back
+};
+
+// Parse position, to go back to when an alternative doesn't match
+struct Mark {
+  unsigned int pos, n;
+};
+
+static Mark mark(const Parser &p) {
+  Mark m = {p.pos, p.n};
+  return m;
+}
+
+static bool restore(Parser &p, const Mark &m) {
+  p.pos = m.pos;
+  p.n = m.n;
+  return false;
+}
+
+static bool emit(Parser &p, unsigned char token) {
+  if (p.n >= BASIC_LINE_MAX) {
+    p.error = BASIC_TOO_LONG;
+    return false;
+  }
+  p.out[p.n++] = token;
+  return true;
+}
+
+static char peek(Parser &p) {
+  while (p.src[p.pos] == ' ') p.pos++;
+  return p.src[p.pos];
+}
+
+static bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+static bool isLetter(char c) {
+  return c >= 'A' && c <= 'Z';
+}
+
+static bool atEnd(Parser &p) {
+  char c = peek(p);
+  return !c || c == ':';
+}
+
+// Keyword / operator text, spaces anywhere in between
+static bool match(Parser &p, const char *word) {
+  unsigned int pos = p.pos;
+  for (; *word; word++) {
+    if (peek(p) != *word) {
+      p.pos = pos;
+      return false;
+    }
+    p.pos++;
+  }
+  return true;
+}
+
+static bool keyword(Parser &p, const char *word, unsigned char token) {
+  return match(p, word) && emit(p, token);
+}
+
+static bool number(Parser &p) {
+  if (!isDigit(peek(p))) return false;
+
+  unsigned char first = p.src[p.pos];
+  unsigned long value = 0;
+  while (isDigit(peek(p))) {
+    value = value * 10 + (p.src[p.pos++] - '0');
+    if (value > BASIC_NUMBER_MAX) {
+      p.error = BASIC_RANGE;
+      return false;
+    }
+  }
+  return emit(p, 0xB0 + first - '0') && emit(p, value & 0xFF) && emit(p, value >> 8);
+}
+
+// Raw chars up to the end of the line or the closing quote
+static bool text(Parser &p, char end) {
+  while (p.src[p.pos] && p.src[p.pos] != end) {
+    if (!emit(p, p.src[p.pos++] | 0x80)) return false;
+  }
+  return true;
+}
+
+static bool literal(Parser &p) {
+  if (peek(p) != '"') return false;
+  p.pos++;
+  if (!emit(p, 0x28) || !text(p, '"')) return false;
+  if (p.src[p.pos] != '"') return false;
+  p.pos++;
+  return emit(p, 0x29);
+}
+
+// Letter and a digit
+static bool numVar(Parser &p) {
+  if (!isLetter(peek(p))) return false;
+  if (!emit(p, p.src[p.pos++] | 0x80)) return false;
+  if (isDigit(peek(p))) return emit(p, p.src[p.pos++] | 0x80);
+  return true;
+}
+
+// Letter and $, no digit
+static bool strVar(Parser &p) {
+  Mark m = mark(p);
+  if (!isLetter(peek(p))) return false;
+  if (!emit(p, p.src[p.pos++] | 0x80)) return false;
+  if (peek(p) != '$') return restore(p, m);
+  p.pos++;
+  return emit(p, 0x40);
+}
+
+static bool startsString(Parser &p) {
+  Mark m = mark(p);
+  if (peek(p) == '"') return true;
+  bool string = strVar(p);
+  restore(p, m);
+  return string;
+}
+
+static bool expr(Parser &p);
+
+// ( token expr )
+static bool paren(Parser &p, unsigned char token) {
+  return keyword(p, "(", token) && expr(p) && keyword(p, ")", 0x72);
+}
+
+static bool strExpr(Parser &p) {
+  if (literal(p)) return true;
+  if (p.error || !strVar(p)) return false;
+  if (!keyword(p, "(", 0x2A)) return !p.error;
+  if (!expr(p)) return false;
+  if (keyword(p, ",", 0x23) && !expr(p)) return false;
+  return keyword(p, ")", 0x72);
+}
+
+static const struct {
+  const char    *name;
+  unsigned char token;
+} FUNCTIONS[] = {
+  {"PEEK", 0x2E}, {"RND", 0x2F}, {"SGN", 0x30}, {"ABS", 0x31}, {"USR", 0x32}
+};
+
+// Longer operators first, ">=" before ">"
+static const struct {
+  const char    *name;
+  unsigned char token;
+} OPERATORS[] = {
+  {"+", 0x12}, {"-", 0x13}, {"*", 0x14}, {"/", 0x15}, {"=", 0x16}, {"#", 0x17},
+  {">=", 0x18}, {">", 0x19}, {"<=", 0x1A}, {"<>", 0x1B}, {"<", 0x1C},
+  {"AND", 0x1D}, {"OR", 0x1E}, {"MOD", 0x1F}, {"^", 0x20}
+};
+
+static bool primary(Parser &p) {
+  Mark m = mark(p);
+
+  if (paren(p, 0x38)) return true;
+  if (p.error) return false;
+  restore(p, m);
+
+  for (unsigned int i = 0; i < sizeof(FUNCTIONS) / sizeof(FUNCTIONS[0]); i++) {
+    if (keyword(p, FUNCTIONS[i].name, FUNCTIONS[i].token) && paren(p, 0x3F)) return true;
+    if (p.error) return false;
+    restore(p, m);
+  }
+
+  if (keyword(p, "LEN(", 0x3B) && strExpr(p) && keyword(p, ")", 0x72)) return true;
+  if (p.error) return false;
+  restore(p, m);
+
+  // String comparison
+  if (strExpr(p) && (keyword(p, "=", 0x39) || keyword(p, "#", 0x3A)) && strExpr(p)) return true;
+  if (p.error) return false;
+  restore(p, m);
+
+  if (number(p)) return true;
+  if (p.error) return false;
+
+  if (!numVar(p)) return false;
+  m = mark(p);
+  if (paren(p, 0x2D)) return true;
+  if (p.error) return false;
+  restore(p, m);
+  return true;
+}
+
+// One unary operator at most before each operand
+static bool operand(Parser &p) {
+  if (p.error) return false;
+  Mark m = mark(p);
+  if (keyword(p, "-", 0x36) || keyword(p, "+", 0x35) || keyword(p, "NOT", 0x37)) {
+    if (primary(p)) return true;
+    return restore(p, m);
+  }
+  return !p.error && primary(p);
+}
+
+static bool expr(Parser &p) {
+  if (!operand(p)) return false;
+
+  for (;;) {
+    Mark m = mark(p);
+    unsigned int i = 0;
+    for (; i < sizeof(OPERATORS) / sizeof(OPERATORS[0]); i++) {
+      if (keyword(p, OPERATORS[i].name, OPERATORS[i].token)) break;
+    }
+    if (p.error) return false;
+    if (i == sizeof(OPERATORS) / sizeof(OPERATORS[0])) return true;
+    if (!operand(p)) {
+      if (p.error) return false;
+      restore(p, m);
+      return true;
+    }
+  }
+}
+
+// Variable of INPUT / assignment, subscript token of its kind
+static bool assignVar(Parser &p) {
+  if (strVar(p)) {
+    return !keyword(p, "(", 0x42) ? !p.error : expr(p) && keyword(p, ")", 0x72);
+  }
+  if (p.error || !numVar(p)) return false;
+  return !keyword(p, "(", 0x2D) ? !p.error : expr(p) && keyword(p, ")", 0x72);
+}
+
+static bool assignment(Parser &p) {
+  if (startsString(p)) {
+    return assignVar(p) && keyword(p, "=", 0x70) && strExpr(p);
+  }
+  return assignVar(p) && keyword(p, "=", 0x71) && expr(p);
+}
+
+// String / numeric item, after a separator of the right kind
+static bool item(Parser &p, unsigned char str_token, unsigned char num_token) {
+  if (startsString(p)) return emit(p, str_token) && strExpr(p);
+  return emit(p, num_token) && expr(p);
+}
+
+static bool print(Parser &p) {
+  if (atEnd(p)) return emit(p, 0x63);
+  if (!item(p, 0x61, 0x62)) return false;
+
+  for (;;) {
+    if (match(p, ";")) {
+      if (atEnd(p)) return emit(p, 0x47);
+      if (!item(p, 0x45, 0x46)) return false;
+    } else if (match(p, ",")) {
+      if (!item(p, 0x48, 0x49)) return false;
+    } else {
+      return true;
+    }
+  }
+}
+
+static bool inputVars(Parser &p) {
+  if (!assignVar(p)) return false;
+  while (match(p, ",")) {
+    if (!emit(p, startsString(p) ? 0x26 : 0x27) || !assignVar(p)) return false;
+  }
+  return true;
+}
+
+static bool input(Parser &p) {
+  if (peek(p) == '"') {
+    if (!emit(p, 0x53) || !literal(p)) return false;
+    if (!match(p, ",")) return true;
+    if (!emit(p, startsString(p) ? 0x26 : 0x27)) return false;
+    return inputVars(p);
+  }
+  return emit(p, startsString(p) ? 0x52 : 0x54) && inputVars(p);
+}
+
+static bool dimItem(Parser &p) {
+  if (strVar(p)) return paren(p, 0x22);
+  return !p.error && numVar(p) && paren(p, 0x34);
+}
+
+static bool dim(Parser &p) {
+  if (!emit(p, startsString(p) ? 0x4E : 0x4F) || !dimItem(p)) return false;
+  while (match(p, ",")) {
+    if (!emit(p, startsString(p) ? 0x43 : 0x44) || !dimItem(p)) return false;
+  }
+  return true;
+}
+
+static bool statement(Parser &p);
+
+// THEN line number, else THEN statement
+static bool then(Parser &p) {
+  Mark m = mark(p);
+  if (emit(p, 0x24) && number(p) && atEnd(p)) return true;
+  if (p.error) return false;
+  restore(p, m);
+  return emit(p, 0x25) && statement(p);
+}
+
+static bool statement(Parser &p) {
+  if (keyword(p, "LET", 0x5E)) return assignment(p);
+  if (match(p, "PRINT")) return print(p);
+  if (match(p, "INPUT")) return input(p);
+  if (match(p, "DIM")) return dim(p);
+  if (keyword(p, "IF", 0x60)) return expr(p) && match(p, "THEN") && then(p);
+  if (keyword(p, "GOTO", 0x5F)) return expr(p);
+  if (keyword(p, "GOSUB", 0x5C)) return expr(p);
+  if (keyword(p, "RETURN", 0x5B)) return true;
+  if (keyword(p, "END", 0x51)) return true;
+  if (keyword(p, "REM", 0x5D)) return text(p, 0);
+  if (keyword(p, "FOR", 0x55)) {
+    return numVar(p) && keyword(p, "=", 0x56) && expr(p) && keyword(p, "TO", 0x57) && expr(p) &&
+      (!keyword(p, "STEP", 0x58) ? !p.error : expr(p));
+  }
+  if (keyword(p, "NEXT", 0x59)) {
+    if (!numVar(p)) return false;
+    while (keyword(p, ",", 0x5A)) {
+      if (!numVar(p)) return false;
+    }
+    return !p.error;
+  }
+  if (keyword(p, "CALL", 0x4D)) return expr(p);
+  if (keyword(p, "TAB", 0x50)) return expr(p);
+  if (keyword(p, "POKE", 0x64)) return expr(p) && keyword(p, ",", 0x65) && expr(p);
+  if (keyword(p, "COLOR=", 0x66)) return expr(p);
+  if (keyword(p, "PLOT", 0x67)) return expr(p) && keyword(p, ",", 0x68) && expr(p);
+  if (keyword(p, "HLIN", 0x69)) {
+    return expr(p) && keyword(p, ",", 0x6A) && expr(p) && keyword(p, "AT", 0x6B) && expr(p);
+  }
+  return !p.error && assignment(p);
+}
+
+unsigned int basicTokenize(const char *source, unsigned char *line, BasicError &error) {
+  Parser p = {source, 0, line, 3, BASIC_OK};
+
+  unsigned int length = 0;
+  while (source[length]) length++;
+  if (length > BASIC_INPUT_MAX) {
+    error = BASIC_INPUT_LONG;
+    return 0;
+  }
+
+  // Line number
+  if (!isDigit(peek(p))) {
+    error = BASIC_NO_NUMBER;
+    return 0;
+  }
+  unsigned long value = 0;
+  while (isDigit(peek(p))) {
+    value = value * 10 + (source[p.pos++] - '0');
+    if (value > BASIC_NUMBER_MAX) {
+      error = BASIC_RANGE;
+      return 0;
+    }
+  }
+  line[1] = value & 0xFF;
+  line[2] = value >> 8;
+
+  // Number alone: delete the line
+  if (!peek(p)) {
+    line[0] = 3;
+    error = BASIC_OK;
+    return 3;
+  }
+
+  // Statements, a trailing ':' is fine
+  for (;;) {
+    if (!statement(p)) break;
+    if (!peek(p)) {
+      emit(p, BASIC_EOL);
+      break;
+    }
+    if (!keyword(p, ":", 0x03)) break;
+    if (!peek(p)) {
+      emit(p, BASIC_EOL);
+      break;
+    }
+  }
+
+  if (!p.error && (p.src[p.pos] || p.out[p.n - 1] != BASIC_EOL)) p.error = BASIC_SYNTAX;
+  error = p.error;
+  if (error != BASIC_OK) return 0;
+  line[0] = p.n;
+  return p.n;
+}
+
+// -- Detokenizer -------------------------------------------------------------
+
+// Token names as LIST prints them. A leading space is dropped after a space.
+static const char *const NAMES[128] = {
+  ",", "", " _ ", ":", " LIST ", ",", " LIST ", " RUN ",
+  " RUN ", " DEL ", ",", " SCR ", " CLR ", " AUTO ", ",", " OFF ",
+  " HIMEM=", " LOMEM=", "+", "-", "*", "/", "=", "#",
+  ">=", ">", "<=", "<>", "<", " AND ", " OR ", " MOD ",
+  " ^ ", "+", "(", ",", " THEN ", " THEN ", ",", ",",
+  "\"", "\"", "(", "!", "!", "(", " PEEK ", " RND ",
+  " SGN ", " ABS ", " USR ", " RNDX ", "(", "+", "-", " NOT ",
+  "(", "=", "#", " LEN(", " COLOR ", " HIMEM ", " LOMEM ", "(",
+  "$", "$", "(", ",", ",", ";", ";", ";",
+  ",", ",", "!", "  ", " ", " CALL ", " DIM ", " DIM ",
+  " TAB ", " END ", " INPUT ", " INPUT ", " INPUT ", " FOR ", "=", " TO ",
+  " STEP ", " NEXT ", ",", " RETURN ", " GOSUB ", " REM ", " LET ", " GOTO ",
+  " IF ", " PRINT ", " PRINT ", " PRINT ", " POKE ", ",", " COLOR=", " PLOT ",
+  ",", " HLIN ", ",", " AT ", " _ ", ",", "+", "-",
+  "=", "=", ")", ")", " _ ", ",", "+", "-",
+  " O ", ")", "+", "5", " O ", ")", " O ", ")"
+};
+
+struct Text {
+  char          *buf;
+  unsigned int  size;
+  unsigned int  len;
+  bool          compact;    // No spaces around the names
+};
+
+static bool put(Text &t, char c) {
+  if (t.len + 1 >= t.size) return false;
+  t.buf[t.len++] = c;
+  t.buf[t.len] = 0;
+  return true;
+}
+
+static bool putName(Text &t, const char *name) {
+  if (*name == ' ' && t.len && t.buf[t.len - 1] == ' ') name++;
+  for (; *name; name++) {
+    if (t.compact && *name == ' ') continue;
+    if (!put(t, *name)) return false;
+  }
+  return true;
+}
+
+static bool putNumber(Text &t, unsigned int value) {
+  char digits[6];
+  int n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  while (n) {
+    if (!put(t, digits[--n])) return false;
+  }
+  return true;
+}
+
+static unsigned int detokenize(const unsigned char *line, unsigned int size, bool list, Text &t) {
+  if (!t.size) return 0;
+  t.buf[0] = 0;
+  if (size < 4 || line[0] != size || line[size - 1] != BASIC_EOL) return 0;
+
+  unsigned int number = line[1] | line[2] << 8;
+  if (list) {
+    for (unsigned int n = 10000; n > 1 && number < n; n /= 10) put(t, ' ');
+  }
+  if (!putNumber(t, number)) return 0;
+
+  bool letter = false;    // Last token a variable letter, a digit after it is part of the name
+  unsigned int i = 3;
+  while (i < size - 1) {
+    unsigned char token = line[i++];
+
+    if (token < 0x80) {
+      letter = false;
+      if (token == BASIC_EOL) return 0;
+      if (token == 0x5D) {
+        // REM, the text as typed (LIST adds a space)
+        if (!putName(t, list ? " REM " : " REM")) return 0;
+        while (i < size - 1) {
+          if (!put(t, line[i++] & 0x7F)) return 0;
+        }
+        return t.len;
+      }
+      if (!putName(t, NAMES[token])) return 0;
+      if (token == 0x28) {
+        while (i < size - 1 && line[i] != 0x29) {
+          if (!put(t, line[i++] & 0x7F)) return 0;
+        }
+      }
+      continue;
+    }
+
+    if (token >= 0xB0 && token <= 0xB9 && !letter) {
+      // Number, LIST drops a leading 0 that has to be typed to get the token back
+      if (i + 2 > size - 1) return 0;
+      unsigned int value = line[i] | line[i + 1] << 8;
+      i += 2;
+      if (!list && token == 0xB0 && value && !put(t, '0')) return 0;
+      if (!putNumber(t, value)) return 0;
+      continue;
+    }
+
+    // Variable name, LIST spaces it from the line number
+    if (i == 4 && !t.compact && !put(t, ' ')) return 0;
+    if (!put(t, token & 0x7F)) return 0;
+    letter = token >= 0xC1 && token <= 0xDA;
+  }
+
+  // No space after the last name ("END ") in the source form
+  if (!list && t.buf[t.len - 1] == ' ') t.buf[--t.len] = 0;
+  return t.len;
+}
+
+unsigned int basicDetokenize(const unsigned char *line, unsigned int size, bool list,
+  char *text, unsigned int text_size) {
+  Text t = {text, text_size, 0, false};
+  unsigned int len = detokenize(line, size, list, t);
+
+  // Spaces are ignored, without them it fits in the input buffer as it did
+  // when typed
+  if (!list && len > BASIC_INPUT_MAX) {
+    t.len = 0;
+    t.compact = true;
+    len = detokenize(line, size, list, t);
+  }
+  return len;
+}
+
+// -- Program -----------------------------------------------------------------
+
+static unsigned int lineNumber(const unsigned char *line) {
+  return line[1] | line[2] << 8;
+}
+
+bool basicInsert(unsigned char *program, unsigned int &size, unsigned int max,
+  const unsigned char *line) {
+  unsigned int number = lineNumber(line);
+
+  // First line with a number not below this one
+  unsigned int at = 0;
+  while (at < size && lineNumber(program + at) < number) at += program[at];
+
+  unsigned int old = 0;
+  if (at < size && lineNumber(program + at) == number) old = program[at];
+  unsigned int len = line[0] > 3 ? line[0] : 0;
+  if (size - old + len > max) return false;
+
+  memmove(program + at + len, program + at + old, size - at - old);
+  memcpy(program + at, line, len);
+  size = size - old + len;
+  return true;
+}
+
+// -- Loader ------------------------------------------------------------------
+
+static unsigned int read16(unsigned int address) {
+  return busRead(address) | busRead(address + 1) << 8;
+}
+
+static void write16(unsigned int address, unsigned int value) {
+  busWrite(address, value & 0xFF);
+  busWrite(address + 1, value >> 8);
+}
+
+unsigned int basicProgramSize() {
+  unsigned int pp = read16(BASIC_PP), himem = read16(BASIC_HIMEM);
+  return pp && pp < himem ? himem - pp : 0;
+}
+
+bool basicStarted() {
+  return read16(BASIC_LOMEM) != 0;
+}
+
+unsigned int basicLoadAddress(unsigned int size) {
+  unsigned int lomem = read16(BASIC_LOMEM), himem = read16(BASIC_HIMEM);
+  if (!lomem || himem < lomem + size) return 0;
+  return himem - size;
+}
+
+unsigned int basicMakeRoom(unsigned int size) {
+  if (!basicStarted()) basicReset();
+  unsigned int lomem = read16(BASIC_LOMEM), himem = read16(BASIC_HIMEM);
+  if (himem < lomem + size && lomem > BASIC_LOMEM_LOW && himem >= BASIC_LOMEM_LOW + size) {
+    write16(BASIC_LOMEM, BASIC_LOMEM_LOW);
+    write16(BASIC_PV, BASIC_LOMEM_LOW);
+  }
+  return basicLoadAddress(size);
+}
+
+void basicLoadDone(unsigned int address) {
+  write16(BASIC_PP, address);
+  write16(BASIC_PV, read16(BASIC_LOMEM));
+}
+
+void basicScratch() {
+  basicLoadDone(read16(BASIC_HIMEM));
+}
+
+void basicReset(unsigned int lomem) {
+  write16(BASIC_LOMEM, lomem);
+  write16(BASIC_HIMEM, BASIC_HIMEM_INIT);
+  basicScratch();
+}
+
+bool basicLoad(const unsigned char *program, unsigned int size) {
+  unsigned int address = basicLoadAddress(size);
+  if (!address) return false;
+  for (unsigned int i = 0; i < size; i++) busWrite(address + i, program[i]);
+  basicLoadDone(address);
+  return true;
+}
@@ -0,0 +1,95 @@
+#ifndef INTBASIC_H
+#define INTBASIC_H
+
+// Apple 1 (Integer) BASIC program format: source lines to the tokens BASIC
+// keeps in memory and back, and loading a program straight into the RAM.
+//
+// The program sits under HIMEM, from PP up, lines in ascending order:
+//
+//   [size] [number Low] [number High] [tokens...] [BASIC_EOL]
+//
+// Tokens below $80 are keywords, operators & separators: the same text can
+// have several tokens, BASIC picks them from the syntax (PRINT is $61 before
+// a string, $62 before a number, $63 alone...). $B0-$B9 + 2 bytes (Low,
+// High) is a number, its first digit in the token. Bytes from $80 up are the
+// chars of a variable name, of a string between $28 & $29, of a REM text.
+
+// BASIC zero page pointers
+const unsigned int BASIC_LOMEM = 0x4A;    // Variables start
+const unsigned int BASIC_HIMEM = 0x4C;    // Program end
+const unsigned int BASIC_PP    = 0xCA;    // Program start
+const unsigned int BASIC_PV    = 0xCC;    // Variables end
+
+// BASIC cold start (E000R) memory layout, with the 4KB of RAM at $0000
+const unsigned int BASIC_LOMEM_INIT = 0x0800;
+const unsigned int BASIC_HIMEM_INIT = 0x1000;
+const unsigned int BASIC_LOMEM_LOW  = 0x0300;   // Lowest sane LOMEM=, above the input buffer
+
+const unsigned char BASIC_EOL = 0x01;     // Line end token
+const unsigned int BASIC_LINE_MAX = 165;  // Tokenized line, larger is TOO LONG
+const unsigned int BASIC_INPUT_MAX = 127; // Chars of a typed line (input buffer)
+const unsigned int BASIC_NUMBER_MAX = 32767;
+
+enum BasicError {
+  BASIC_OK,
+  BASIC_SYNTAX,     // *** SYNTAX ERR
+  BASIC_RANGE,      // *** >32767 ERR
+  BASIC_TOO_LONG,   // *** TOO LONG ERR
+  BASIC_NO_NUMBER,  // No line number: BASIC would run it, not store it
+  BASIC_INPUT_LONG  // Longer than the input buffer, can't be typed
+};
+
+// Message of an error, as BASIC prints it when it has one
+const char *basicErrorText(BasicError error);
+
+// Tokenize a source line ("10 PRINT X"). The line goes to line (at least
+// BASIC_LINE_MAX bytes), its size is returned, 0 on error. A line number
+// alone is a line to delete: size 3, no tokens, no BASIC_EOL.
+unsigned int basicTokenize(const char *source, unsigned char *line, BasicError &error);
+
+// Text of a tokenized line, 0 terminated in text (text_size bytes).
+// list: exactly as LIST prints it (without the 40 column wrap), else as it
+// has to be typed to get these very tokens back. Return the text length,
+// 0 if the line is malformed or the text doesn't fit.
+unsigned int basicDetokenize(const unsigned char *line, unsigned int size, bool list,
+  char *text, unsigned int text_size);
+
+// Put a tokenized line in a program (lines in order), in place of the line
+// with the same number if any. A line of size 3 deletes it. False if the
+// program would get over max bytes.
+bool basicInsert(unsigned char *program, unsigned int &size, unsigned int max,
+  const unsigned char *line);
+
+// Size of the program in the emulated RAM (PP to HIMEM), 0 if none or BASIC
+// was never started
+unsigned int basicProgramSize();
+
+// BASIC was started: LOMEM is set (0 in a RAM BASIC never ran on)
+bool basicStarted();
+
+// Where a program of that size goes (under HIMEM), 0 if it doesn't fit
+// above LOMEM
+unsigned int basicLoadAddress(unsigned int size);
+
+// Get room for a program of that size before a load: BASIC not started gets
+// the memory layout of a cold start (basicReset()), and LOMEM goes down to
+// BASIC_LOMEM_LOW if that's what it takes, clearing the variables as the
+// load would. Return basicLoadAddress(size).
+unsigned int basicMakeRoom(unsigned int size);
+
+// Make the program loaded at address the current one: PP moves down to it,
+// variables are cleared (PV = LOMEM), as after a LOAD
+void basicLoadDone(unsigned int address);
+
+// No program, no variables (as SCR)
+void basicScratch();
+
+// Memory layout of a BASIC cold start (E000R) and LOMEM=, no program. BASIC
+// can then be entered with a warm start (E2B3R), keeping what gets loaded.
+void basicReset(unsigned int lomem = BASIC_LOMEM_INIT);
+
+// Copy a program (lines in order) under HIMEM and make it the current one.
+// False if it doesn't fit.
+bool basicLoad(const unsigned char *program, unsigned int size);
+
+#endif
@@ -1,6 +1,11 @@
 #include <Arduino.h>
-#include "rom.h"
-#include "programs.h"
+#include "apple1.h"
+#include "blockdev.h"
+#include "config.h"
+#include "intbasic.h"
+#include "rewind.h"
+#include "scheduler.h"
+#include "trace.h"
 
 #define CHECK_BIT(var,pos) ((var) & (1<<(pos)))
 
@@ -10,10 +15,19 @@ const int CLOCK_DELAY_PIN = A0;  // Clock delay PIN (potentiometer)
 int CLOCK_DELAY = 5;  // HIGH / LOW CLOCK STATE DELAY (You can slow down it as much as you want)
 
 const char SERIAL_BS = 0x08;
+const char REWIND_KEY = 0x12;  // Ctrl-R, then the number of cycles & Enter (REWIND)
+const char LOAD_KEY = 0x02;    // Ctrl-B, then a BASIC program load stream (host/basic.cpp)
+const unsigned long LOAD_TIMEOUT = 1000;  // Milliseconds without a byte, load cancelled
+
+// Housekeeping periods (scheduler.h)
+const uint32_t POT_PERIOD      = 20000;  // Microseconds, the pot is read 50 times a second
+const uint32_t KEYBOARD_PERIOD = 64;     // Cycles, a few turns of the WOZ monitor key loop
+const uint32_t TRACE_PERIOD    = 10000;  // Microseconds, trace buffer flush
 
 // 6502 to Arduino Pin Mapping
 const int CLOCK_PIN   = 52; // TO 6502 CLOCK
 const int RW_PIN      = 53; // TO 6502 R/W
+const int RDY_PIN     = 51; // TO 6502 RDY
 const int ADDRESS_PINS[]  = {44,45,2,3,4,5,6,7,8,9,10,11,12,13,46,47}; // TO ADDRESS PIN 1-15 6502
 const int DATA_PINS[]     = {33, 34, 35, 36, 37,38, 39, 40}; // TO DATA BUS PIN 0-7 6502
 
@@ -23,8 +37,8 @@ const int DATA_PINS[]     = {33, 34, 35, 36, 37,38, 39, 40}; // TO DATA BUS PIN
         3.3v      GND                          10uf ---- GND
          |        |       +------\/------+      |
          |        +----  1| VPB     /RES |40 ---+------- +RST BTN- ---- GND
-         +--- 3k3 -----  2| RDY    PHI2O |39
-         |               3| PHI1O    SOB |38
+         +--- 3k3 ---+-  2| RDY    PHI2O |39
+         |           51  3| PHI1O    SOB |38
          +--- 3k3 -----  4| IRQ     PHI2 |37 -------- 52
          |               5| MLB       BE |36---3k3--------3.3v
          +--- 3k3 -----  6| /NMI      NC |35
@@ -47,10 +61,6 @@ const int DATA_PINS[]     = {33, 34, 35, 36, 37,38, 39, 40}; // TO DATA BUS PIN
 */
 
 
-const unsigned int ROM_ADDR       = 0xFF00; // ROM
-const unsigned int RAM_BANK1_ADDR = 0x0000; // RAM
-const unsigned int RAM_BANK2_ADDR = 0xE000; // EXTENDED RAM
-
 const unsigned int XAML = 0x24;   // Last "opened" location Low
 const unsigned int XAMH = 0x25;   // Last "opened" location High
 const unsigned int STL  = 0x26;   // Store address Low
@@ -61,26 +71,6 @@ const unsigned int YSAV = 0x2A;   // Used to see if hex value is given
 const unsigned int MODE = 0x2B;   // $00=XAM, $7F=STOR, $AE=BLOCK XAM
 const unsigned int IN   = 0x200;  // Input buffer ($0200,$027F)
 
-const int RAM_BANK_1_SIZE = 4096;
-const int RAM_BANK_2_SIZE = 4096;
-unsigned char RAM_BANK_1[RAM_BANK_1_SIZE];
-unsigned char RAM_BANK_2[RAM_BANK_2_SIZE];
-
-// PIA MAPPING 6821
-const unsigned int PIA_ADDR   = 0xD000; // PIA 6821 ADDR BASE SPACE
-const unsigned int KBD_ADDR   = 0xD010; // Keyb Char - B7 High on keypress
-const unsigned int KBDCR_ADDR = 0xD011; // Keyb Status - B7 High on keypress / Low when ready
-const unsigned int DSP_ADDR   = 0xD012; // DSP Char
-const unsigned int DSPCR_ADDR = 0xD013; // DSP Status - B7 Low if VIDEO ready
-unsigned char KBD   = 0;
-unsigned char KBDCR = 0;
-unsigned char DSP   = 0;
-unsigned char DSPCR = 0;
-
-const unsigned char BS      = 0xDF;  // Backspace key, arrow left key (B7 High)
-const unsigned char CR      = 0x8D;  // Carriage Return (B7 High)
-const unsigned char ESC     = 0x9B;  // ESC key (B7 High)
-
 // 6502 States buffer
 unsigned int  address;    // Current address (from 6502)
 unsigned char bus_data;   // Data Bus value (from 6502)
@@ -92,6 +82,23 @@ unsigned int  pre_address;    // Previous address (from 6502)
 unsigned char pre_bus_data;   // Previous Bus value (from 6502)
 int pre_rw_state;             // Previous R/W state (from 6502)
 
+// RDY Low: the 6502 repeats the current cycle until we serve it
+bool rdy_wait = false;
+
+// RDY is open drain: the 3k3 pull-up holds it High and the W65C02S pulls it
+// Low by itself on WAI, so pin 51 never drives it High. Holding the 6502
+// turns the output on with its level already Low, releasing it turns it off.
+void holdRdy(bool hold) {
+  Pio *port = g_APinDescription[RDY_PIN].pPort;
+  uint32_t mask = g_APinDescription[RDY_PIN].ulPin;
+  if (hold) {
+    port->PIO_CODR = mask;
+    port->PIO_OER = mask;
+  } else {
+    port->PIO_ODR = mask;
+  }
+}
+
 
 // Set Arduino Address connected PINS as INPUT
 void setupAddressPins() {
@@ -144,238 +151,363 @@ void byteToDataBus(unsigned char data) {
   }
 }
 
-void PIAWrite() {
-  switch (address) {
-
-    // Keyboard
-    case KBD_ADDR:
-      KBD=bus_data;
-      break;
-
-    case KBDCR_ADDR:
-      KBDCR=bus_data;
-      break;
-
-    // Display
-    case DSP_ADDR:
-      DSP=bus_data;
-
-      switch(DSP) {
-        case CR:
-          Serial.write('\r');
-          Serial.write('\n');
-          break;
-        case BS:
-          Serial.write(SERIAL_BS);
-          break;
-        default:
-          Serial.write(DSP & 0x7F);
-          break;
-      }
-
-      bitClear(DSP, 7);
-      break;
-
-    case DSPCR_ADDR:
-      DSPCR=bus_data;
-      break;
-  }
-}
-
 // READ FROM DATA BUS - STORE AT RELATED ADDRESS
 void readFromDataBus() {
   readData();
-
-  switch (address >> 12) {
-    case 0x0:
-      RAM_BANK_1[address-RAM_BANK1_ADDR]=bus_data;
-      break;
-    case 0xE:
-      RAM_BANK_2[address-RAM_BANK2_ADDR]=bus_data;
-      break;
-    case 0xD:
-      PIAWrite();
-      break;
-  }
+  busWrite(address, bus_data);
 }
 
-unsigned char PIARead() {
-  unsigned char val;
-  // PIA 6821
-  switch (address) {
-
-    case KBD_ADDR:
-      val=KBD;
-      // We'v read the char, clear B7
-      bitClear(KBDCR, 7);
-      break;
+void writeToDataBus() {
+  bus_data = busRead(address);
+  byteToDataBus(bus_data);
+}
 
-    case KBDCR_ADDR:
-      val=KBDCR;
-      break;
+// DSP output goes to the serial monitor
+void displayWrite(unsigned char dsp) {
+  if (Machine::DISPLAY == PORT_NONE) return;
 
-    case DSP_ADDR:
-      val=DSP;
+  switch(dsp) {
+    case CR:
+      Serial.write('\r');
+      Serial.write('\n');
       break;
-
-    case DSPCR_ADDR:
-      val=DSPCR;
+    case BS:
+      Serial.write(SERIAL_BS);
       break;
-
     default:
-      val=0;
+      Serial.write(dsp & 0x7F);
       break;
   }
-
-  return val;
 }
 
-void writeToDataBus() {
-  unsigned char val=0;
-
-  switch (address >> 12) {
+// Rewind command typed on the serial port: ^R N <CR>. True if the key was
+// part of it, the 6502 never sees those.
+bool rewind_cmd = false;
+RewindCycle rewind_arg = 0;
+
+bool rewindCommand(char key) {
+  if (key == REWIND_KEY) {
+    rewind_cmd = true;
+    rewind_arg = 0;
+    Serial.print("\r\nREWIND ");
+    return true;
+  }
+  if (!rewind_cmd) return false;
 
-    // $0000-$0FFF 4KB Standard RAM
-    case 0x0:
-      val=RAM_BANK_1[address-RAM_BANK1_ADDR];
-      break;
+  if (key >= '0' && key <= '9') {
+    rewind_arg = rewind_arg * 10 + (key - '0');
+    Serial.write(key);
+    return true;
+  }
 
-    // $E000-$EFFF 4KB Extended RAM
-    case 0xE:
-      val=RAM_BANK_2[address-RAM_BANK2_ADDR];
-      break;
+  rewind_cmd = false;
+  RewindCycle back;
+  if (key != '\r') {
+    Serial.println(" CANCELLED");
+  } else if (rewindBack(rewind_arg, back)) {
+    Serial.print(" -> ");
+    Serial.print(back);
+    Serial.println(" CYCLES BACK, RESET TO EXAMINE");
+  } else {
+    Serial.println(" -> NO HISTORY THAT OLD");
+  }
+  return true;
+}
 
-    // $FF00-$FFFF 256 Bytes ROM
-    case 0xF:
-      val=ROM[address-ROM_ADDR];
-      break;
+// BASIC program load sent on the serial port (basic -o): ^B, size Low,
+// size High, the program as BASIC keeps it in memory, 8 bit sum. It goes
+// under HIMEM and replaces the current program, as a LOAD from tape would,
+// LOMEM lowered if it needs the room (basicMakeRoom()). Before BASIC was
+// ever started, it gets BASIC's memory layout and a warm start (E2B3R)
+// enters BASIC with the program.
+// The whole stream is read at once: the W65C02S is fully static, it waits
+// with the clock stopped.
+int loadByte() {
+  unsigned long start = millis();
+  while (Serial.available() <= 0) {
+    if (millis() - start > LOAD_TIMEOUT) return -1;
+  }
+  return Serial.read();
+}
 
-    // $D010-$D013 PIA (6821) [KBD & DSP]
-    case 0xD:
-      val=PIARead();
-      break;
+void loadCommand() {
+  Serial.print("\r\nLOAD ");
 
-    // Segmentation Fault. Just return 0
-    default:
-      val=0;
-      break;
+  int low = loadByte(), high = loadByte();
+  if (low < 0 || high < 0) {
+    Serial.println("-> TIMEOUT");
+    return;
+  }
+  unsigned int size = low | high << 8;
+  bool started = basicStarted();
+  unsigned int load_address = basicMakeRoom(size);
+
+  // Read it all even when it doesn't fit, the rest isn't keys
+  unsigned char sum = 0;
+  for (unsigned int i = 0; i < size; i++) {
+    int data = loadByte();
+    if (data < 0) {
+      if (load_address && i) {
+        basicScratch();
+        Serial.println("-> TIMEOUT, PROGRAM CLEARED");
+      } else {
+        Serial.println("-> TIMEOUT");
+      }
+      return;
+    }
+    if (load_address) busWrite(load_address + i, data);
+    sum += data;
   }
 
-  byteToDataBus(val);
+  int check = loadByte();
+  if (!load_address) {
+    Serial.println("-> TOO BIG, NO ROOM UNDER HIMEM");
+  } else if (check != sum) {
+    basicScratch();
+    Serial.println("-> BAD CHECKSUM, PROGRAM CLEARED");
+  } else {
+    basicLoadDone(load_address);
+    Serial.print(size);
+    Serial.print(" BYTES AT $");
+    Serial.print(load_address, HEX);
+    Serial.println(started ? "" : ", E2B3R TO ENTER BASIC");
+  }
 }
 
+template <class Config>
 void handleKeyboard() {
   // KEYBOARD INPUT
-  if (Serial.available() > 0) {
-    char tempKBD = Serial.read();
-    switch (tempKBD) {
-      case 0xA:
-        // Not expected from KEYB
-        // Just ignore
-        return;
-        break;
-      case 0x8:
-      case 0x7F:
-        // BS
-        tempKBD = 0x5F;
-        break;
-    }
+  if (Config::KEYBOARD != PORT_SERIAL || Serial.available() <= 0) return;
 
-    KBD = tempKBD;
+  // The rewind command goes through even if the 6502 stopped reading keys
+  if (Config::REWIND && (rewind_cmd || Serial.peek() == REWIND_KEY)) {
+    rewindCommand(Serial.read());
+    return;
+  }
 
-    bitSet(KBD, 7);
-    bitSet(KBDCR, 7);
+  // BASIC lives in the extended RAM
+  if (Config::ERAM && Serial.peek() == LOAD_KEY) {
+    Serial.read();
+    loadCommand();
+    return;
   }
+
+  // Keys wait in the serial buffer until the 6502 read the last one
+  if (keyboardReady()) keyPress(Serial.read());
 }
 
-void loadBASIC() {
-  // LOAD BASIC in E000
-  for (unsigned int i = 0; i < sizeof(BASIC) ; i++) {
-    RAM_BANK_2[i] = BASIC[i];
+// step() cost in Due cycles (84 MHz), from the Cortex-M3 cycle counter
+const unsigned long STATS_STEPS = 1UL << 20;  // Report every 1M steps
+unsigned long stats_steps = 0;
+unsigned long long stats_total = 0;
+unsigned long stats_max = 0;
+
+void startStats() {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+void stepStats(unsigned long cycles) {
+  stats_total += cycles;
+  if (cycles > stats_max) stats_max = cycles;
+
+  if (++stats_steps == STATS_STEPS) {
+    if (SerialUSB) {
+      SerialUSB.print("STEP: AVG ");
+      SerialUSB.print((unsigned long)(stats_total / STATS_STEPS));
+      SerialUSB.print(" MAX ");
+      SerialUSB.print(stats_max);
+      SerialUSB.println(" CYCLES");
+    }
+    stats_steps = 0;
+    stats_total = 0;
+    stats_max = 0;
   }
-  Serial.println("BASIC LOADED");
 }
 
-void loadPROG() {
-  // LOAD A PROG
-  unsigned int prg_addr = AUTLOAD[1] | AUTLOAD[0] << 8;
-  Serial.print("PROGRAM AT: ");
-  Serial.println(prg_addr, HEX);
+// Trace records go out on the native USB port by packets, a write per
+// record costs a USB transfer each
+const unsigned int TRACE_BUFFER = 16;  // Records, a 64 bytes packet
+TraceRecord trace_buffer[TRACE_BUFFER];
+unsigned int trace_len = 0;
 
-  for (unsigned int i = 0; i < sizeof(AUTLOAD)-2 ; i++) {
-    RAM_BANK_1[prg_addr+i] = AUTLOAD[i+2];
+void flushTrace() {
+  if (trace_len) {
+    SerialUSB.write((const uint8_t *)trace_buffer, trace_len * sizeof(TraceRecord));
+    trace_len = 0;
   }
 }
 
+// Send the cycle on the native USB port (see trace.h): served, or held on
+// RDY (TRACE_HELD)
+void traceBus(unsigned char flags) {
+  TraceRecord rec = {(unsigned char)address, (unsigned char)(address >> 8), bus_data,
+    (unsigned char)(flags | (rw_state ? TRACE_READ : 0))};
+  trace_buffer[trace_len++] = rec;
+  if (trace_len == TRACE_BUFFER) flushTrace();
+}
+
+// Housekeeping tasks, run by the scheduler out of the bus loop (scheduler.h)
+void readPot() {
+  CLOCK_DELAY=analogRead(CLOCK_DELAY_PIN);
+}
+
+void pollKeyboard() {
+  handleKeyboard<Machine>();
+}
+
+uint32_t dueMicros() {
+  return micros();
+}
+
+void startTasks() {
+  schedMicros = dueMicros;
+  schedStart();
+  if (Machine::POT) schedAdd("POT", readPot, SCHED_MICROS, POT_PERIOD);
+  if (Machine::KEYBOARD == PORT_SERIAL) schedAdd("KEYBOARD", pollKeyboard, SCHED_CYCLES, KEYBOARD_PERIOD);
+  if (Machine::TRACE) schedAdd("TRACE", flushTrace, SCHED_MICROS, TRACE_PERIOD);
+}
+
 void setup() {
   pinMode(CLOCK_PIN, OUTPUT);
+  pinMode(RDY_PIN, INPUT);
   pinMode(RW_PIN, INPUT);
   pinMode(RW_PIN, INPUT);
 
-  // You can remove the PIN input here and just set CLOCK_DELAY as const
-  // Remove also the analogRead on CLOCK_DELAY_PIN in step() below.
-  pinMode(CLOCK_DELAY_PIN, INPUT);
-  CLOCK_DELAY=analogRead(CLOCK_DELAY_PIN);
-  // End of remove
+  // No pot fitted (FastConfig, config.h): CLOCK_DELAY is never used
+  if (Machine::POT) {
+    pinMode(CLOCK_DELAY_PIN, INPUT);
+    CLOCK_DELAY=analogRead(CLOCK_DELAY_PIN);
+  }
 
 
   setupAddressPins();
   setBusMode(OUTPUT);
 
   Serial.begin(SERIAL_SPEED);
+  if (Machine::TRACE || Machine::STATS) SerialUSB.begin(0);
+  if (Machine::STATS) startStats();
 
   Serial.println("----------------------------");
   Serial.println("APPLE 1 REPLICA by =STID=");
   Serial.println("----------------------------");
   Serial.print("ROM:  ");
-  Serial.print(sizeof(ROM));
+  Serial.print(ROM_SIZE);
   Serial.println(" BYTE");
   Serial.print("RAM:  ");
   Serial.print(sizeof(RAM_BANK_1));
   Serial.println(" BYTE");
-  Serial.print("ERAM: ");
-  Serial.print(sizeof(RAM_BANK_2));
-  Serial.println(" BYTE");
+  if (Machine::ERAM) {
+    Serial.print("ERAM: ");
+    Serial.print(sizeof(RAM_BANK_2));
+    Serial.println(" BYTE");
+  }
+  if (Machine::BLOCK_DEV) {
+    Serial.print("BLOCK DEV: $");
+    Serial.print(BLK_ADDR, HEX);
+    Serial.print(" (");
+    Serial.print(BLK_COUNT);
+    Serial.println(" BLOCKS)");
+  }
   Serial.print("CLOCK DELAY: ");
-  Serial.println(CLOCK_DELAY);
+  if (Machine::POT) {
+    Serial.println(CLOCK_DELAY);
+  } else {
+    Serial.println("NONE");
+  }
+
+  // BASIC needs the extended RAM
+  if (Machine::ERAM) {
+    loadBASIC();
+    Serial.println("BASIC LOADED, ^B PROGRAM LOAD");
+  }
 
-  loadBASIC();
-  loadPROG();
+  Serial.print("PROGRAM AT: ");
+  Serial.println(loadPROG(), HEX);
+
+  startTasks();
+
+  // History starts with the memory as loaded
+  if (Machine::REWIND) {
+    rewindStart();
+    Serial.print("REWIND: ");
+    Serial.print(REWIND_JOURNAL);
+    Serial.println(" WRITES, ^R N <CR>");
+  }
 
   Serial.println("----------------------------");
 }
 
+template <class Config>
 void handleClock() {
   // LOW CLOCK
   digitalWrite(CLOCK_PIN, LOW);
-  delayMicroseconds(CLOCK_DELAY);
+  if (Config::POT && CLOCK_DELAY) delayMicroseconds(CLOCK_DELAY);
 
   // RW STATE
   handleRWState();
 
   // HIGH CLOCK
   digitalWrite(CLOCK_PIN, HIGH);
-  delayMicroseconds(CLOCK_DELAY);
+  if (Config::POT && CLOCK_DELAY) delayMicroseconds(CLOCK_DELAY);
 }
 
+// Only I/O accesses may need slow work. When it can't be done right now
+// (serial output buffer full) RDY goes Low: the 6502 holds the cycle while
+// the clock keeps running, and we serve it as soon as there's room.
+template <class Config>
+void handleIO() {
+  if (Config::DISPLAY == PORT_SERIAL && ioMustWait(address, rw_state, Serial.availableForWrite())) {
+    if (!rdy_wait) {
+      holdRdy(true);
+      rdy_wait = true;
+    }
+    return;
+  }
+
+  if (rdy_wait) {
+    holdRdy(false);
+    rdy_wait = false;
+  }
+
+  rw_state ? writeToDataBus() : readFromDataBus();
+}
+
+template <class Config>
 void handleBusRW() {
   // If nothing changed from the last cycle, we don't need to update anything
-  if (pre_address != address || pre_rw_state != rw_state) {
+  // (unless the 6502 is still waiting for us on RDY)
+  if (pre_address != address || pre_rw_state != rw_state || rdy_wait) {
     // READ OR WRITE TO BUS?
-    rw_state ? writeToDataBus() : readFromDataBus();
+    if (isIOAccess(address)) {
+      handleIO<Config>();
+      if (rdy_wait) {
+        if (Config::TRACE) traceBus(TRACE_HELD);
+        return;
+      }
+    } else {
+      rw_state ? writeToDataBus() : readFromDataBus();
+    }
+    if (Config::TRACE) traceBus(0);
     pre_address = address;
     pre_rw_state = rw_state;
   }
 }
 
+template <class Config>
 void step() {
-  CLOCK_DELAY=analogRead(CLOCK_DELAY_PIN); // Can be removed, see setup()
-  handleClock();
+  unsigned long start = Config::STATS ? DWT->CYCCNT : 0;
+
+  handleClock<Config>();
   readAddress();
-  handleBusRW();
-  handleKeyboard();
+  handleBusRW<Config>();
+  if (Config::REWIND) rewindTick(1);
+  schedTick(1);
+
+  if (Config::STATS) stepStats(DWT->CYCCNT - start);
 }
 
 void loop () {
-    step();
-}
\ No newline at end of file
+    step<Machine>();
+}
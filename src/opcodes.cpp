@@ -0,0 +1,89 @@
+#include "cpu6502.h"
+
+const unsigned char MODE_SIZE[] = {
+  1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 2, 2, 2, 2, 3, 3
+};
+
+// W65C02S opcode matrix (unused opcodes are NOPs of the documented size)
+const Opcode OPCODES[256] = {
+  // 0x00
+  {"BRK",AM_IMP,7}, {"ORA",AM_IZX,6}, {"NOP",AM_IMM,2}, {"NOP",AM_IMP,1},
+  {"TSB",AM_ZP,5},  {"ORA",AM_ZP,3},  {"ASL",AM_ZP,5},  {"RMB0",AM_ZP,5},
+  {"PHP",AM_IMP,3}, {"ORA",AM_IMM,2}, {"ASL",AM_ACC,2}, {"NOP",AM_IMP,1},
+  {"TSB",AM_ABS,6}, {"ORA",AM_ABS,4}, {"ASL",AM_ABS,6}, {"BBR0",AM_ZPR,5},
+  // 0x10
+  {"BPL",AM_REL,2}, {"ORA",AM_IZY,5}, {"ORA",AM_IZP,5}, {"NOP",AM_IMP,1},
+  {"TRB",AM_ZP,5},  {"ORA",AM_ZPX,4}, {"ASL",AM_ZPX,6}, {"RMB1",AM_ZP,5},
+  {"CLC",AM_IMP,2}, {"ORA",AM_ABY,4}, {"INC",AM_ACC,2}, {"NOP",AM_IMP,1},
+  {"TRB",AM_ABS,6}, {"ORA",AM_ABX,4}, {"ASL",AM_ABX,6}, {"BBR1",AM_ZPR,5},
+  // 0x20
+  {"JSR",AM_ABS,6}, {"AND",AM_IZX,6}, {"NOP",AM_IMM,2}, {"NOP",AM_IMP,1},
+  {"BIT",AM_ZP,3},  {"AND",AM_ZP,3},  {"ROL",AM_ZP,5},  {"RMB2",AM_ZP,5},
+  {"PLP",AM_IMP,4}, {"AND",AM_IMM,2}, {"ROL",AM_ACC,2}, {"NOP",AM_IMP,1},
+  {"BIT",AM_ABS,4}, {"AND",AM_ABS,4}, {"ROL",AM_ABS,6}, {"BBR2",AM_ZPR,5},
+  // 0x30
+  {"BMI",AM_REL,2}, {"AND",AM_IZY,5}, {"AND",AM_IZP,5}, {"NOP",AM_IMP,1},
+  {"BIT",AM_ZPX,4}, {"AND",AM_ZPX,4}, {"ROL",AM_ZPX,6}, {"RMB3",AM_ZP,5},
+  {"SEC",AM_IMP,2}, {"AND",AM_ABY,4}, {"DEC",AM_ACC,2}, {"NOP",AM_IMP,1},
+  {"BIT",AM_ABX,4}, {"AND",AM_ABX,4}, {"ROL",AM_ABX,6}, {"BBR3",AM_ZPR,5},
+  // 0x40
+  {"RTI",AM_IMP,6}, {"EOR",AM_IZX,6}, {"NOP",AM_IMM,2}, {"NOP",AM_IMP,1},
+  {"NOP",AM_ZP,3},  {"EOR",AM_ZP,3},  {"LSR",AM_ZP,5},  {"RMB4",AM_ZP,5},
+  {"PHA",AM_IMP,3}, {"EOR",AM_IMM,2}, {"LSR",AM_ACC,2}, {"NOP",AM_IMP,1},
+  {"JMP",AM_ABS,3}, {"EOR",AM_ABS,4}, {"LSR",AM_ABS,6}, {"BBR4",AM_ZPR,5},
+  // 0x50
+  {"BVC",AM_REL,2}, {"EOR",AM_IZY,5}, {"EOR",AM_IZP,5}, {"NOP",AM_IMP,1},
+  {"NOP",AM_ZPX,4}, {"EOR",AM_ZPX,4}, {"LSR",AM_ZPX,6}, {"RMB5",AM_ZP,5},
+  {"CLI",AM_IMP,2}, {"EOR",AM_ABY,4}, {"PHY",AM_IMP,3}, {"NOP",AM_IMP,1},
+  {"NOP",AM_ABS,8}, {"EOR",AM_ABX,4}, {"LSR",AM_ABX,6}, {"BBR5",AM_ZPR,5},
+  // 0x60
+  {"RTS",AM_IMP,6}, {"ADC",AM_IZX,6}, {"NOP",AM_IMM,2}, {"NOP",AM_IMP,1},
+  {"STZ",AM_ZP,3},  {"ADC",AM_ZP,3},  {"ROR",AM_ZP,5},  {"RMB6",AM_ZP,5},
+  {"PLA",AM_IMP,4}, {"ADC",AM_IMM,2}, {"ROR",AM_ACC,2}, {"NOP",AM_IMP,1},
+  {"JMP",AM_IND,6}, {"ADC",AM_ABS,4}, {"ROR",AM_ABS,6}, {"BBR6",AM_ZPR,5},
+  // 0x70
+  {"BVS",AM_REL,2}, {"ADC",AM_IZY,5}, {"ADC",AM_IZP,5}, {"NOP",AM_IMP,1},
+  {"STZ",AM_ZPX,4}, {"ADC",AM_ZPX,4}, {"ROR",AM_ZPX,6}, {"RMB7",AM_ZP,5},
+  {"SEI",AM_IMP,2}, {"ADC",AM_ABY,4}, {"PLY",AM_IMP,4}, {"NOP",AM_IMP,1},
+  {"JMP",AM_AIX,6}, {"ADC",AM_ABX,4}, {"ROR",AM_ABX,6}, {"BBR7",AM_ZPR,5},
+  // 0x80
+  {"BRA",AM_REL,3}, {"STA",AM_IZX,6}, {"NOP",AM_IMM,2}, {"NOP",AM_IMP,1},
+  {"STY",AM_ZP,3},  {"STA",AM_ZP,3},  {"STX",AM_ZP,3},  {"SMB0",AM_ZP,5},
+  {"DEY",AM_IMP,2}, {"BIT",AM_IMM,2}, {"TXA",AM_IMP,2}, {"NOP",AM_IMP,1},
+  {"STY",AM_ABS,4}, {"STA",AM_ABS,4}, {"STX",AM_ABS,4}, {"BBS0",AM_ZPR,5},
+  // 0x90
+  {"BCC",AM_REL,2}, {"STA",AM_IZY,6}, {"STA",AM_IZP,5}, {"NOP",AM_IMP,1},
+  {"STY",AM_ZPX,4}, {"STA",AM_ZPX,4}, {"STX",AM_ZPY,4}, {"SMB1",AM_ZP,5},
+  {"TYA",AM_IMP,2}, {"STA",AM_ABY,5}, {"TXS",AM_IMP,2}, {"NOP",AM_IMP,1},
+  {"STZ",AM_ABS,4}, {"STA",AM_ABX,5}, {"STZ",AM_ABX,5}, {"BBS1",AM_ZPR,5},
+  // 0xA0
+  {"LDY",AM_IMM,2}, {"LDA",AM_IZX,6}, {"LDX",AM_IMM,2}, {"NOP",AM_IMP,1},
+  {"LDY",AM_ZP,3},  {"LDA",AM_ZP,3},  {"LDX",AM_ZP,3},  {"SMB2",AM_ZP,5},
+  {"TAY",AM_IMP,2}, {"LDA",AM_IMM,2}, {"TAX",AM_IMP,2}, {"NOP",AM_IMP,1},
+  {"LDY",AM_ABS,4}, {"LDA",AM_ABS,4}, {"LDX",AM_ABS,4}, {"BBS2",AM_ZPR,5},
+  // 0xB0
+  {"BCS",AM_REL,2}, {"LDA",AM_IZY,5}, {"LDA",AM_IZP,5}, {"NOP",AM_IMP,1},
+  {"LDY",AM_ZPX,4}, {"LDA",AM_ZPX,4}, {"LDX",AM_ZPY,4}, {"SMB3",AM_ZP,5},
+  {"CLV",AM_IMP,2}, {"LDA",AM_ABY,4}, {"TSX",AM_IMP,2}, {"NOP",AM_IMP,1},
+  {"LDY",AM_ABX,4}, {"LDA",AM_ABX,4}, {"LDX",AM_ABY,4}, {"BBS3",AM_ZPR,5},
+  // 0xC0
+  {"CPY",AM_IMM,2}, {"CMP",AM_IZX,6}, {"NOP",AM_IMM,2}, {"NOP",AM_IMP,1},
+  {"CPY",AM_ZP,3},  {"CMP",AM_ZP,3},  {"DEC",AM_ZP,5},  {"SMB4",AM_ZP,5},
+  {"INY",AM_IMP,2}, {"CMP",AM_IMM,2}, {"DEX",AM_IMP,2}, {"WAI",AM_IMP,3},
+  {"CPY",AM_ABS,4}, {"CMP",AM_ABS,4}, {"DEC",AM_ABS,6}, {"BBS4",AM_ZPR,5},
+  // 0xD0
+  {"BNE",AM_REL,2}, {"CMP",AM_IZY,5}, {"CMP",AM_IZP,5}, {"NOP",AM_IMP,1},
+  {"NOP",AM_ZPX,4}, {"CMP",AM_ZPX,4}, {"DEC",AM_ZPX,6}, {"SMB5",AM_ZP,5},
+  {"CLD",AM_IMP,2}, {"CMP",AM_ABY,4}, {"PHX",AM_IMP,3}, {"STP",AM_IMP,3},
+  {"NOP",AM_ABS,4}, {"CMP",AM_ABX,4}, {"DEC",AM_ABX,7}, {"BBS5",AM_ZPR,5},
+  // 0xE0
+  {"CPX",AM_IMM,2}, {"SBC",AM_IZX,6}, {"NOP",AM_IMM,2}, {"NOP",AM_IMP,1},
+  {"CPX",AM_ZP,3},  {"SBC",AM_ZP,3},  {"INC",AM_ZP,5},  {"SMB6",AM_ZP,5},
+  {"INX",AM_IMP,2}, {"SBC",AM_IMM,2}, {"NOP",AM_IMP,2}, {"NOP",AM_IMP,1},
+  {"CPX",AM_ABS,4}, {"SBC",AM_ABS,4}, {"INC",AM_ABS,6}, {"BBS6",AM_ZPR,5},
+  // 0xF0
+  {"BEQ",AM_REL,2}, {"SBC",AM_IZY,5}, {"SBC",AM_IZP,5}, {"NOP",AM_IMP,1},
+  {"NOP",AM_ZPX,4}, {"SBC",AM_ZPX,4}, {"INC",AM_ZPX,6}, {"SMB7",AM_ZP,5},
+  {"SED",AM_IMP,2}, {"SBC",AM_ABY,4}, {"PLX",AM_IMP,4}, {"NOP",AM_IMP,1},
+  {"NOP",AM_ABS,4}, {"SBC",AM_ABX,4}, {"INC",AM_ABX,7}, {"BBS7",AM_ZPR,5}
+};
@@ -0,0 +1,181 @@
+#include <string.h>
+#include "rewind.h"
+#include "apple1.h"
+
+RewindEntry rewind_journal[REWIND_JOURNAL];
+unsigned int rewind_head = 0;
+unsigned int rewind_count = 0;
+RewindCycle rewind_floor = 0;
+RewindCycle rewind_cycle = 0;
+RewindCycle rewind_last = 0;
+#if !defined(ARDUINO)
+bool rewind_on = false;
+#endif
+
+// Checkpoints are PackBits compressed RAM banks, one after the other in a
+// ring store. Most of the RAM is zeroes, BASIC itself doesn't compress.
+const unsigned int PACK_MAX = RAM_BANK_1_SIZE + RAM_BANK_2_SIZE +
+  (RAM_BANK_1_SIZE + RAM_BANK_2_SIZE) / 128;   // Worst case, all literals
+
+struct Checkpoint {
+  RewindCycle cycle;
+  unsigned int offset;    // In the store
+  unsigned int size;
+  unsigned char kbd, kbdcr, dsp, dspcr;
+};
+
+static unsigned char store[REWIND_STORE];
+static unsigned int store_pos = 0;
+static Checkpoint checkpoints[REWIND_CHECKPOINTS];
+static unsigned int cp_first = 0;     // Oldest
+static unsigned int cp_count = 0;
+
+static_assert(!REWIND_BUILT || REWIND_STORE >= 2 * PACK_MAX, "Rewind store too small");
+static_assert(!(REWIND_JOURNAL & (REWIND_JOURNAL - 1)), "Rewind journal not a power of 2");
+
+// Runs of 3 to 129 equal bytes: 257 - n, byte. Else 1 to 128 literals: n - 1, bytes.
+static unsigned int pack(const unsigned char *src, unsigned int size, unsigned char *dst) {
+  unsigned int in = 0, out = 0;
+  while (in < size) {
+    unsigned int run = 1;
+    while (in + run < size && run < 129 && src[in + run] == src[in]) run++;
+
+    if (run >= 3) {
+      dst[out++] = 257 - run;
+      dst[out++] = src[in];
+      in += run;
+      continue;
+    }
+
+    // Literals, up to the next run of 3
+    unsigned int start = in, count = 0;
+    while (in < size && count < 128) {
+      if (in + 2 < size && src[in] == src[in + 1] && src[in] == src[in + 2]) break;
+      in++;
+      count++;
+    }
+    dst[out++] = count - 1;
+    memcpy(dst + out, src + start, count);
+    out += count;
+  }
+  return out;
+}
+
+static unsigned int unpack(const unsigned char *src, unsigned char *dst, unsigned int size) {
+  unsigned int in = 0, out = 0;
+  while (out < size) {
+    unsigned char n = src[in++];
+    if (n < 128) {
+      memcpy(dst + out, src + in, n + 1);
+      in += n + 1;
+      out += n + 1;
+    } else {
+      memset(dst + out, src[in++], 257 - n);
+      out += 257 - n;
+    }
+  }
+  return in;
+}
+
+static Checkpoint &checkpointAt(unsigned int i) {
+  return checkpoints[(cp_first + i) % REWIND_CHECKPOINTS];
+}
+
+void rewindCheckpoint() {
+  rewind_last = rewind_cycle;
+
+  if (REWIND_STORE - store_pos < PACK_MAX) store_pos = 0;
+
+  // Drop the oldest checkpoints in the way
+  while (cp_count) {
+    const Checkpoint &old = checkpointAt(0);
+    bool overlap = old.offset < store_pos + PACK_MAX && store_pos < old.offset + old.size;
+    if (!overlap && cp_count < REWIND_CHECKPOINTS) break;
+    cp_first = (cp_first + 1) % REWIND_CHECKPOINTS;
+    cp_count--;
+  }
+
+  Checkpoint &cp = checkpointAt(cp_count++);
+  cp.cycle = rewind_cycle;
+  cp.offset = store_pos;
+  cp.size = pack(RAM_BANK_1, RAM_BANK_1_SIZE, store + store_pos);
+  cp.size += pack(RAM_BANK_2, RAM_BANK_2_SIZE, store + store_pos + cp.size);
+  cp.kbd = KBD;
+  cp.kbdcr = KBDCR;
+  cp.dsp = DSP;
+  cp.dspcr = DSPCR;
+  store_pos += cp.size;
+}
+
+void rewindStart() {
+  rewind_head = 0;
+  rewind_count = 0;
+  rewind_floor = 0;
+  rewind_cycle = 0;
+  cp_first = 0;
+  cp_count = 0;
+  store_pos = 0;
+#if !defined(ARDUINO)
+  rewind_on = true;
+#endif
+  rewindCheckpoint();
+}
+
+void rewindRange(unsigned int address, const unsigned char *old, unsigned int size) {
+  for (unsigned int i = 0; i < size; i++) rewindWrite(address + i, old[i]);
+}
+
+static void undo(const RewindEntry &entry) {
+  if (entry.address < RAM_BANK1_ADDR + RAM_BANK_1_SIZE) {
+    RAM_BANK_1[entry.address - RAM_BANK1_ADDR] = entry.old;
+  } else {
+    RAM_BANK_2[entry.address - RAM_BANK2_ADDR] = entry.old;
+  }
+}
+
+bool rewindBack(RewindCycle cycles, RewindCycle &back) {
+  RewindCycle target = rewind_cycle - cycles;
+
+  if (cycles <= rewind_cycle - rewind_floor) {
+    // Journal: undo every write done at or after the target cycle
+    while (rewind_count) {
+      unsigned int last = (rewind_head - 1) & (REWIND_JOURNAL - 1);
+      if (rewind_cycle - rewind_journal[last].cycle > cycles) break;
+      undo(rewind_journal[last]);
+      rewind_head = last;
+      rewind_count--;
+    }
+  } else {
+    // Too far for the journal: newest checkpoint at or before the target
+    unsigned int i = cp_count;
+    while (i && rewind_cycle - checkpointAt(i - 1).cycle < cycles) i--;
+    if (!i) return false;
+
+    const Checkpoint &cp = checkpointAt(i - 1);
+    target = cp.cycle;
+    unsigned int size = unpack(store + cp.offset, RAM_BANK_1, RAM_BANK_1_SIZE);
+    unpack(store + cp.offset + size, RAM_BANK_2, RAM_BANK_2_SIZE);
+    KBD = cp.kbd;
+    KBDCR = cp.kbdcr;
+    DSP = cp.dsp;
+    DSPCR = cp.dspcr;
+
+    // Nothing in the journal is older than that
+    rewind_count = 0;
+    rewind_floor = target;
+  }
+
+  // The history after the target is gone, new writes go on from there
+  back = rewind_cycle - target;
+  while (cp_count && rewind_cycle - checkpointAt(cp_count - 1).cycle < back) cp_count--;
+  if (cp_count) {
+    const Checkpoint &cp = checkpointAt(cp_count - 1);
+    store_pos = cp.offset + cp.size;
+    rewind_last = cp.cycle;
+  } else {
+    rewind_last = target;
+  }
+  rewind_cycle = target;
+  codeWatchHit = true;
+  return true;
+}
@@ -0,0 +1,92 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+// Rewind buffer: the memory history of the Apple 1, to step back to the
+// moment a program went wrong.
+//
+// Every RAM write logs (cycle, address, old value) in a ring journal: any
+// state since the oldest entry still in the journal can be rebuilt exactly,
+// by undoing the writes from the newest one. Further back, the compressed
+// checkpoints of the RAM & PIA taken every REWIND_CHECKPOINT cycles are the
+// only states left.
+//
+// Only the memory goes back in time: the 6502 registers are in the chip,
+// a RESET after a rewind brings the WOZ monitor up to look around.
+// Compiled in with Machine::REWIND (config.h) on the Due. The host tools
+// always have the buffer and turn it on with rewindStart() (RewindHostConfig).
+
+#include <stdint.h>
+#include "config.h"
+
+#if defined(ARDUINO)
+typedef uint32_t RewindCycle;
+const bool REWIND_BUILT = Machine::REWIND;
+#else
+// The software CPU runs 32 bits of cycles in about 20 s
+typedef uint64_t RewindCycle;
+const bool REWIND_BUILT = RewindHostConfig::REWIND;
+#endif
+
+const unsigned int REWIND_JOURNAL = REWIND_BUILT ? 2048 : 1;         // Entries, power of 2
+const unsigned int REWIND_STORE = REWIND_BUILT ? 32768 : 1;          // Checkpoint bytes
+const unsigned int REWIND_CHECKPOINTS = 16;                          // Max checkpoints kept
+const uint32_t REWIND_CHECKPOINT = 1UL << 20;                        // Cycles between two
+
+struct RewindEntry {
+  RewindCycle cycle;
+  uint16_t address;
+  uint8_t  old;
+};
+
+extern RewindEntry rewind_journal[REWIND_JOURNAL];
+extern unsigned int rewind_head;      // Next entry
+extern unsigned int rewind_count;     // Entries in the journal
+extern RewindCycle rewind_floor;      // Oldest cycle the journal can go back to
+extern RewindCycle rewind_cycle;      // Current cycle
+extern RewindCycle rewind_last;       // Cycle of the last checkpoint
+
+// History on: always with Machine::REWIND on the Due, after rewindStart()
+// on the host
+#if defined(ARDUINO)
+inline bool rewindOn() { return Machine::REWIND; }
+#else
+extern bool rewind_on;
+inline bool rewindOn() { return rewind_on; }
+#endif
+
+// Start the history with the current memory as cycle 0
+void rewindStart();
+
+// Take a checkpoint now
+void rewindCheckpoint();
+
+// Log a RAM write, before the RAM changes
+inline void rewindWrite(unsigned int address, unsigned char old) {
+  RewindEntry &entry = rewind_journal[rewind_head];
+  if (rewind_count == REWIND_JOURNAL) {
+    rewind_floor = entry.cycle + 1;
+  } else {
+    rewind_count++;
+  }
+  entry.cycle = rewind_cycle;
+  entry.address = address;
+  entry.old = old;
+  rewind_head = (rewind_head + 1) & (REWIND_JOURNAL - 1);
+}
+
+// Log a block of RAM about to be overwritten at once (block device)
+void rewindRange(unsigned int address, const unsigned char *old, unsigned int size);
+
+// Count elapsed cycles
+inline void rewindTick(unsigned int cycles) {
+  rewind_cycle += cycles;
+  if (rewind_cycle - rewind_last >= REWIND_CHECKPOINT) rewindCheckpoint();
+}
+
+// Bring the RAM back to its state of the given number of cycles ago: exactly
+// if the journal goes back that far, else to the newest checkpoint older than
+// that (PIA included). back returns how far it actually went, the history
+// after that point is dropped. False (nothing changed) if nothing is that old.
+bool rewindBack(RewindCycle cycles, RewindCycle &back);
+
+#endif
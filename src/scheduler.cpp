@@ -0,0 +1,96 @@
+#include <stddef.h>
+#include "scheduler.h"
+
+SchedTask sched_tasks[SCHED_TASKS];
+unsigned int sched_count = 0;
+int32_t sched_countdown = SCHED_POLL;
+uint32_t (*schedMicros)() = NULL;
+
+const int32_t SCHED_IDLE = 1L << 30;      // Countdown with no task due
+
+static uint32_t sched_cycle = 0;          // Cycle of the last dispatch
+static int32_t sched_reload = SCHED_POLL; // Countdown set then
+
+uint32_t schedCycles() {
+  return sched_cycle + (uint32_t)(sched_reload - sched_countdown);
+}
+
+// Set the countdown to the next cycle task, or to the next poll of the
+// microsecond tasks
+static void reload() {
+  int32_t wait = SCHED_IDLE;
+  for (unsigned int i = 0; i < sched_count; i++) {
+    const SchedTask &task = sched_tasks[i];
+    int32_t left = task.unit == SCHED_MICROS ? SCHED_POLL : (int32_t)(task.next - sched_cycle);
+    if (left < wait) wait = left;
+  }
+  if (wait < 1) wait = 1;
+
+  sched_reload = wait;
+  sched_countdown = wait;
+}
+
+void schedStart() {
+  sched_count = 0;
+  sched_cycle = 0;
+  reload();
+}
+
+SchedTask *schedAdd(const char *name, void (*run)(), SchedUnit unit, uint32_t period) {
+  if (sched_count == SCHED_TASKS || !period || period > (uint32_t)SCHED_IDLE) return NULL;
+
+  // Cycle 0 is the last dispatch, count from the current cycle
+  uint32_t now = schedCycles();
+  sched_cycle = now;
+
+  SchedTask &task = sched_tasks[sched_count++];
+  task.name = name;
+  task.run = run;
+  task.unit = unit;
+  task.period = period;
+  task.next = (unit == SCHED_MICROS ? schedMicros() : now) + period;
+  task.runs = 0;
+  task.skipped = 0;
+  task.late = 0;
+
+  reload();
+  return &task;
+}
+
+// Run the task if due. A task late by more than a period runs once, the
+// periods missed are counted as skipped.
+static void dispatch(SchedTask &task, uint32_t now) {
+  uint32_t late = now - task.next;
+  if ((int32_t)late < 0) return;
+
+  if (late > task.late) task.late = late;
+  task.next += task.period;
+  if ((int32_t)(now - task.next) >= 0) {
+    uint32_t missed = (now - task.next) / task.period + 1;
+    task.skipped += missed;
+    task.next += missed * task.period;
+  }
+  task.runs++;
+  task.run();
+}
+
+void schedRun() {
+  sched_cycle = schedCycles();
+
+  uint32_t time = 0;
+  bool timed = false;
+  for (unsigned int i = 0; i < sched_count; i++) {
+    SchedTask &task = sched_tasks[i];
+    if (task.unit == SCHED_CYCLES) {
+      dispatch(task, sched_cycle);
+    } else {
+      if (!timed) {
+        time = schedMicros();
+        timed = true;
+      }
+      dispatch(task, time);
+    }
+  }
+
+  reload();
+}
@@ -0,0 +1,59 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+// Housekeeping scheduler: the jobs that don't need every bus cycle (pot,
+// keyboard, trace flush, reports...) run every so many emulated cycles or
+// microseconds. The bus loop only counts cycles down with schedTick(), the
+// tasks due are dispatched when the count reaches 0.
+//
+// A cycle task due at cycle N runs at the end of the step that reaches N.
+// A microsecond task is checked at least every SCHED_POLL cycles.
+
+#include <stdint.h>
+
+enum SchedUnit {
+  SCHED_CYCLES,
+  SCHED_MICROS
+};
+
+struct SchedTask {
+  const char    *name;
+  void          (*run)();
+  SchedUnit     unit;
+  uint32_t      period;       // Cycles or microseconds
+  uint32_t      next;         // Cycle / time of the next run
+  unsigned long runs;
+  unsigned long skipped;      // Periods missed, already late by a whole period
+  uint32_t      late;         // Max cycles / microseconds past due
+};
+
+const unsigned int SCHED_TASKS = 8;   // Max tasks
+const int32_t SCHED_POLL = 256;       // Max cycles between two checks of the microsecond tasks
+
+extern SchedTask sched_tasks[SCHED_TASKS];
+extern unsigned int sched_count;
+extern int32_t sched_countdown;       // Cycles to the next dispatch
+
+// Time source of the microsecond tasks (micros() on the Due)
+extern uint32_t (*schedMicros)();
+
+// Drop every task, cycle 0 is now
+void schedStart();
+
+// Add a task, first run one period from now. NULL if the table is full or
+// the period is 0 or over 2^30.
+SchedTask *schedAdd(const char *name, void (*run)(), SchedUnit unit, uint32_t period);
+
+// Run the tasks due, set the next countdown
+void schedRun();
+
+// Count elapsed cycles
+inline void schedTick(uint32_t cycles) {
+  sched_countdown -= cycles;
+  if (sched_countdown <= 0) schedRun();
+}
+
+// Cycles since schedStart()
+uint32_t schedCycles();
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Bus trace: one 4 bytes record per bus cycle, as seen on the 6502 pins.
+// Sent by the sketch on the native USB port (BUS_TRACE) and written by the
+// headless mode (-r FILE). A cycle the sketch holds on RDY is recorded once
+// per clock it's held (TRACE_HELD), then once more when it's served.
+
+struct TraceRecord {
+  unsigned char addr_lo;  // A0-A7
+  unsigned char addr_hi;  // A8-A15
+  unsigned char data;     // D0-D7
+  unsigned char flags;
+};
+
+const unsigned char TRACE_READ = 0x01;  // R/W High, the 6502 reads
+const unsigned char TRACE_HELD = 0x02;  // RDY Low, not served: the 6502 repeats this cycle
+
+#endif
@@ -0,0 +1,208 @@
+// Rewind buffer (rewind.h) against a replay of the writes, on the host.
+//
+// The test logs every RAM write it does through the bus with its cycle.
+// The RAM at cycle T is the first RAM with every write done before T
+// applied: each rewindBack() must leave exactly that, for the cycle it says
+// it went back to, and go back exactly as far as asked while the journal
+// reaches.
+//
+//   pio test -e test
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <unity.h>
+#include "apple1.h"
+#include "rewind.h"
+
+void displayWrite(unsigned char) {
+}
+
+struct Write {
+  RewindCycle   cycle;
+  unsigned int  address;
+  unsigned char data;
+};
+
+static std::vector<Write> writes;
+static unsigned char first_ram1[RAM_BANK_1_SIZE], first_ram2[RAM_BANK_2_SIZE];
+static RewindCycle cycle = 0;
+
+static uint32_t seed = 1;
+
+static uint32_t nextRandom() {
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+// Writes are spread over both banks, mostly in a few hot spots as programs do
+static unsigned int randomAddress() {
+  uint32_t r = nextRandom();
+  unsigned int offset = (r & 3) ? (r >> 4) % 64 : (r >> 4) % RAM_BANK_1_SIZE;
+  return ((r >> 2) & 1) ? RAM_BANK2_ADDR + offset : RAM_BANK1_ADDR + 0x300 + offset % 0xD00;
+}
+
+static void write(unsigned int address, unsigned char data) {
+  Write w = {cycle, address, data};
+  writes.push_back(w);
+  busWrite(address, data);
+}
+
+static void tick(unsigned int cycles) {
+  cycle += cycles;
+  rewindTick(cycles);
+}
+
+// Some 6502 steps, one in four writes a byte
+static void run(unsigned long steps) {
+  for (unsigned long i = 0; i < steps; i++) {
+    if (!(nextRandom() & 3)) write(randomAddress(), nextRandom());
+    tick(2 + nextRandom() % 6);
+  }
+}
+
+// RAM as it was at cycle target
+static void replay(RewindCycle target, unsigned char *ram1, unsigned char *ram2) {
+  memcpy(ram1, first_ram1, RAM_BANK_1_SIZE);
+  memcpy(ram2, first_ram2, RAM_BANK_2_SIZE);
+  for (unsigned int i = 0; i < writes.size() && writes[i].cycle < target; i++) {
+    const Write &w = writes[i];
+    if (w.address >= RAM_BANK2_ADDR) {
+      ram2[w.address - RAM_BANK2_ADDR] = w.data;
+    } else {
+      ram1[w.address - RAM_BANK1_ADDR] = w.data;
+    }
+  }
+}
+
+// Rewind by cycles, check the RAM and drop the history after it as the
+// buffer does. went is how far it went. False if there is nothing that old:
+// the RAM must not have changed then.
+static bool back(RewindCycle cycles, RewindCycle &went) {
+  static unsigned char ram1[RAM_BANK_1_SIZE], ram2[RAM_BANK_2_SIZE];
+  memcpy(ram1, RAM_BANK_1, RAM_BANK_1_SIZE);
+  memcpy(ram2, RAM_BANK_2, RAM_BANK_2_SIZE);
+  if (!rewindBack(cycles, went)) {
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(ram1, RAM_BANK_1, RAM_BANK_1_SIZE, "RAM bank 1 changed");
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(ram2, RAM_BANK_2, RAM_BANK_2_SIZE, "RAM bank 2 changed");
+    return false;
+  }
+  TEST_ASSERT_TRUE(went >= cycles);
+
+  RewindCycle target = cycle - went;
+  replay(target, ram1, ram2);
+  TEST_ASSERT_EQUAL_MEMORY_MESSAGE(ram1, RAM_BANK_1, RAM_BANK_1_SIZE, "RAM bank 1");
+  TEST_ASSERT_EQUAL_MEMORY_MESSAGE(ram2, RAM_BANK_2, RAM_BANK_2_SIZE, "RAM bank 2");
+
+  while (!writes.empty() && writes.back().cycle >= target) writes.pop_back();
+  cycle = target;
+  return true;
+}
+
+// Rewind that the journal covers
+static void backExactly(RewindCycle cycles) {
+  RewindCycle went;
+  TEST_ASSERT_TRUE(back(cycles, went));
+  TEST_ASSERT_EQUAL_UINT64(cycles, went);
+}
+
+static void start() {
+  memset(RAM_BANK_1, 0, RAM_BANK_1_SIZE);
+  loadBASIC();
+  memcpy(first_ram1, RAM_BANK_1, RAM_BANK_1_SIZE);
+  memcpy(first_ram2, RAM_BANK_2, RAM_BANK_2_SIZE);
+  writes.clear();
+  cycle = 0;
+  seed = 1;
+  rewindStart();
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+// The host tools don't journal anything until they start the history
+void test_off_until_started() {
+  TEST_ASSERT_FALSE(rewindOn());
+  busWrite(0x0300, 0x55);
+  busWrite(0xE010, 0xAA);
+  TEST_ASSERT_EQUAL_UINT32(0, rewind_count);
+  start();
+  TEST_ASSERT_TRUE(rewindOn());
+  busWrite(0x0300, 0x56);
+  TEST_ASSERT_EQUAL_UINT32(1, rewind_count);
+}
+
+void test_exact_within_the_journal() {
+  start();
+  run(20000);
+  for (unsigned int i = 0; i < 50; i++) {
+    backExactly(nextRandom() % 40);
+    run(nextRandom() % 100);
+  }
+}
+
+// Back from checkpoint to checkpoint until the oldest one kept
+void test_checkpoint_past_the_journal() {
+  start();
+  run(REWIND_CHECKPOINT);   // About 4.5 checkpoints worth of cycles
+  unsigned int landed = 0;
+  RewindCycle went;
+  while (back(50000 + nextRandom() % 400000, went)) {
+    landed++;
+    run(nextRandom() % 1000);
+  }
+  TEST_ASSERT_TRUE(landed >= 2);
+}
+
+// As far as the journal says it goes, once it dropped its oldest entries
+void test_oldest_journal_cycle() {
+  start();
+  run(20000);
+  TEST_ASSERT_TRUE(rewind_floor > 0);
+  backExactly(cycle - rewind_floor);
+}
+
+// The checkpoints taken after a rewind leave the one it landed on alone
+void test_checkpoints_after_a_rewind() {
+  start();
+  run(REWIND_CHECKPOINT / 2);
+  RewindCycle went;
+  TEST_ASSERT_TRUE(back(cycle - REWIND_CHECKPOINT / 2, went));
+  run(REWIND_CHECKPOINT / 2);
+  TEST_ASSERT_TRUE(back(cycle, went));
+  TEST_ASSERT_EQUAL_UINT64(0, cycle);
+}
+
+void test_nothing_that_old() {
+  start();
+  run(1000);
+  RewindCycle went = 12345;
+  TEST_ASSERT_FALSE(back(cycle + 1, went));
+  TEST_ASSERT_EQUAL_UINT64(12345, went);
+  backExactly(cycle);
+}
+
+// The cycles go on past 32 bits on the host, the journal still works there
+void test_history_past_32_bits() {
+  start();
+  tick(0xFFFFF000u);
+  run(5000);
+  TEST_ASSERT_TRUE(cycle > 0xFFFFFFFFull);
+  backExactly(cycle - 0xFFFFF400u);
+  TEST_ASSERT_TRUE(cycle < 0xFFFFFFFFull);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_off_until_started);
+  RUN_TEST(test_exact_within_the_journal);
+  RUN_TEST(test_checkpoint_past_the_journal);
+  RUN_TEST(test_oldest_journal_cycle);
+  RUN_TEST(test_checkpoints_after_a_rewind);
+  RUN_TEST(test_nothing_that_old);
+  RUN_TEST(test_history_past_32_bits);
+  return UNITY_END();
+}
@@ -0,0 +1,190 @@
+// Scheduler (scheduler.h) against its spec, on the host:
+//
+// - a cycle task of period P due at cycle k*P runs at the end of the step
+//   that reaches k*P, once even if the step covered several periods, and
+//   counts the periods it missed as skipped
+// - a microsecond task is checked at least every SCHED_POLL cycles
+//
+// The expected runs come from the step sizes alone: the test keeps its own
+// cycle count and works out which multiples of P each step crossed.
+//
+//   pio test -e test
+
+#include <stdint.h>
+#include <vector>
+#include <unity.h>
+#include "scheduler.h"
+
+// Memory map of the test env, unused here
+void displayWrite(unsigned char) {
+}
+
+const unsigned int MAX_STEP = 7;      // Longest 6502 instruction
+
+// Test clock, in emulated cycles
+static uint64_t cycle = 0;
+static uint32_t micros_now = 0;
+
+static uint32_t testMicros() {
+  return micros_now;
+}
+
+// Cycle of each run, per task
+static std::vector<uint64_t> runs[SCHED_TASKS];
+
+template <int N>
+static void record() {
+  runs[N].push_back(cycle);
+}
+
+static void (*const RECORD[SCHED_TASKS])() = {
+  record<0>, record<1>, record<2>, record<3>, record<4>, record<5>, record<6>, record<7>
+};
+
+// Same steps on every run: 1 to MAX_STEP cycles
+static uint32_t seed = 1;
+
+static unsigned int nextStep() {
+  seed = seed * 1103515245 + 12345;
+  return 1 + (seed >> 16) % MAX_STEP;
+}
+
+void setUp() {
+  cycle = 0;
+  micros_now = 0;
+  seed = 1;
+  for (unsigned int i = 0; i < SCHED_TASKS; i++) runs[i].clear();
+  schedMicros = testMicros;
+  schedStart();
+}
+
+void tearDown() {
+}
+
+// What a cycle task added at cycle start with this period should do over steps
+struct Expected {
+  std::vector<uint64_t> runs;
+  unsigned long skipped;
+  uint64_t late;
+};
+
+static Expected expect(const std::vector<unsigned int> &steps, uint64_t start, uint32_t period) {
+  Expected e;
+  e.skipped = 0;
+  e.late = 0;
+  uint64_t now = 0, due = start + period;
+  for (unsigned int i = 0; i < steps.size(); i++) {
+    now += steps[i];
+    if (now < due) continue;
+    uint64_t crossed = (now - due) / period + 1;
+    e.runs.push_back(now);
+    e.skipped += crossed - 1;
+    if (now - due > e.late) e.late = now - due;
+    due += crossed * period;
+  }
+  return e;
+}
+
+static void runSteps(const std::vector<unsigned int> &steps) {
+  for (unsigned int i = 0; i < steps.size(); i++) {
+    cycle += steps[i];
+    schedTick(steps[i]);
+  }
+}
+
+static std::vector<unsigned int> makeSteps(unsigned int count) {
+  std::vector<unsigned int> steps;
+  for (unsigned int i = 0; i < count; i++) steps.push_back(nextStep());
+  return steps;
+}
+
+static void checkTask(unsigned int n, const Expected &e) {
+  const SchedTask &task = sched_tasks[n];
+  TEST_ASSERT_EQUAL_UINT32(e.runs.size(), runs[n].size());
+  TEST_ASSERT_TRUE(e.runs == runs[n]);
+  TEST_ASSERT_EQUAL_UINT32(e.runs.size(), task.runs);
+  TEST_ASSERT_EQUAL_UINT32(e.skipped, task.skipped);
+  TEST_ASSERT_EQUAL_UINT32(e.late, task.late);
+}
+
+void test_cycle_tasks_run_on_the_step_reaching_them() {
+  const uint32_t PERIODS[] = {1, 3, 7, 64, 1000, 4093, 65536};
+  const unsigned int COUNT = sizeof(PERIODS) / sizeof(PERIODS[0]);
+  for (unsigned int i = 0; i < COUNT; i++) {
+    TEST_ASSERT_NOT_NULL(schedAdd("cycles", RECORD[i], SCHED_CYCLES, PERIODS[i]));
+  }
+
+  std::vector<unsigned int> steps = makeSteps(200000);
+  runSteps(steps);
+
+  for (unsigned int i = 0; i < COUNT; i++) checkTask(i, expect(steps, 0, PERIODS[i]));
+  TEST_ASSERT_EQUAL_UINT32(cycle, schedCycles());
+}
+
+void test_a_task_added_later_counts_from_then() {
+  TEST_ASSERT_NOT_NULL(schedAdd("first", RECORD[0], SCHED_CYCLES, 100));
+  std::vector<unsigned int> before = makeSteps(1000);
+  runSteps(before);
+  uint64_t added = cycle;
+
+  TEST_ASSERT_NOT_NULL(schedAdd("second", RECORD[1], SCHED_CYCLES, 37));
+  std::vector<unsigned int> after = makeSteps(1000);
+  runSteps(after);
+
+  std::vector<unsigned int> all = before;
+  all.insert(all.end(), after.begin(), after.end());
+  checkTask(0, expect(all, 0, 100));
+
+  Expected second = expect(after, 0, 37);
+  for (unsigned int i = 0; i < second.runs.size(); i++) second.runs[i] += added;
+  checkTask(1, second);
+}
+
+void test_micro_tasks_are_polled() {
+  const uint32_t PERIOD = 1000;
+  TEST_ASSERT_NOT_NULL(schedAdd("micros", RECORD[0], SCHED_MICROS, PERIOD));
+
+  // 1 us per cycle: due at k * PERIOD, seen within a poll
+  uint64_t last_run = 0;
+  std::vector<uint32_t> seen;
+  for (unsigned int i = 0; i < 100000; i++) {
+    unsigned int step = nextStep();
+    cycle += step;
+    micros_now += step;
+    size_t before = runs[0].size();
+    schedTick(step);
+    if (runs[0].size() != before) {
+      seen.push_back(micros_now);
+      last_run = cycle;
+    }
+  }
+  unsigned long expected = micros_now / PERIOD;
+
+  TEST_ASSERT_TRUE(seen.size() == expected || seen.size() + 1 == expected);
+  for (unsigned int k = 0; k < seen.size(); k++) {
+    uint32_t due = (k + 1) * PERIOD;
+    TEST_ASSERT_TRUE(seen[k] >= due);
+    TEST_ASSERT_TRUE(seen[k] - due < (uint32_t)SCHED_POLL + MAX_STEP);
+  }
+  TEST_ASSERT_TRUE(cycle - last_run < PERIOD + SCHED_POLL + MAX_STEP);
+  TEST_ASSERT_EQUAL_UINT32(0, sched_tasks[0].skipped);
+}
+
+void test_add_rejects_bad_tasks() {
+  TEST_ASSERT_NULL(schedAdd("zero", RECORD[0], SCHED_CYCLES, 0));
+  TEST_ASSERT_NULL(schedAdd("huge", RECORD[0], SCHED_CYCLES, (1UL << 30) + 1));
+  for (unsigned int i = 0; i < SCHED_TASKS; i++) {
+    TEST_ASSERT_NOT_NULL(schedAdd("task", RECORD[i], SCHED_CYCLES, 10));
+  }
+  TEST_ASSERT_NULL(schedAdd("full", RECORD[0], SCHED_CYCLES, 10));
+  TEST_ASSERT_EQUAL_UINT32(SCHED_TASKS, sched_count);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_cycle_tasks_run_on_the_step_reaching_them);
+  RUN_TEST(test_a_task_added_later_counts_from_then);
+  RUN_TEST(test_micro_tasks_are_polled);
+  RUN_TEST(test_add_rejects_bad_tasks);
+  return UNITY_END();
+}